@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <new>
+
+#include "MyVector.h"
+
+
+// Bump allocator for short-lived groups of objects, such as everything built
+// while serving one request. Memory comes from an optional initial buffer and
+// then from chunks of the upstream resource that double in size.
+// deallocate takes back the most recent allocation, and returns a chunk to
+// upstream once everything allocated from it has been freed, so the buffers
+// a growing vector leaves behind do not pile up. Everything else is returned
+// at once by release() or the destructor. resize_in_place lets the most
+// recent allocation grow without moving; ArenaVector uses it through
+// ArenaAllocator. Not thread-safe.
+class ArenaResource : public std::pmr::memory_resource {
+private:
+    struct Chunk {
+        Chunk* prev;
+        size_t size;
+        size_t live;  // allocations from this chunk not yet freed
+    };
+
+    std::pmr::memory_resource* upstream;
+    char* initial_buffer = nullptr;
+    size_t initial_size = 0;
+    size_t first_chunk_size;
+    size_t next_chunk_size;
+    Chunk* chunks = nullptr;
+    char* cur = nullptr;
+    char* end = nullptr;
+
+    static char* align_up(char* p, size_t alignment) {
+        auto address = reinterpret_cast<uintptr_t>(p);
+        return p + ((alignment - address % alignment) % alignment);
+    }
+
+    void add_chunk(size_t bytes, size_t alignment) {
+        size_t size = std::max(next_chunk_size, sizeof(Chunk) + bytes + alignment);
+        auto* chunk = static_cast<Chunk*>(upstream->allocate(size, alignof(std::max_align_t)));
+        chunk->prev = chunks;
+        chunk->size = size;
+        chunk->live = 0;
+        chunks = chunk;
+        cur = reinterpret_cast<char*>(chunk + 1);
+        end = reinterpret_cast<char*>(chunk) + size;
+        next_chunk_size = size * 2;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        char* p = align_up(cur, alignment);
+        if (!cur || p > end || static_cast<size_t>(end - p) < bytes) {
+            add_chunk(bytes, alignment);
+            p = align_up(cur, alignment);
+        }
+        cur = p + bytes;
+        // once there is a chunk, allocations come from the newest one
+        if (chunks && bytes != 0) {
+            ++chunks->live;
+        }
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t) override {
+        // a zero-size block may sit at the end of its chunk, so it isn't counted
+        if (bytes == 0) {
+            return;
+        }
+        char* block = static_cast<char*>(p);
+        std::less<const char*> less;
+        for (Chunk** link = &chunks; *link; link = &(*link)->prev) {
+            Chunk* chunk = *link;
+            char* begin = reinterpret_cast<char*>(chunk + 1);
+            if (less(block, begin) || !less(block, reinterpret_cast<char*>(chunk) + chunk->size)) {
+                continue;
+            }
+            --chunk->live;
+            if (chunk != chunks) {
+                if (chunk->live == 0) {
+                    *link = chunk->prev;
+                    upstream->deallocate(chunk, chunk->size, alignof(std::max_align_t));
+                }
+            } else if (chunk->live == 0) {
+                cur = begin;
+            } else if (block + bytes == cur) {
+                cur = block;
+            }
+            return;
+        }
+        if (block + bytes == cur) {
+            cur = block;
+        }
+    }
+
+    [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit ArenaResource(size_t first_chunk_size = 4096,
+                           std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+            : upstream(upstream)
+            , first_chunk_size(first_chunk_size)
+            , next_chunk_size(first_chunk_size) {}
+
+    // Serves allocations from buffer first, e.g. an array on the stack.
+    ArenaResource(void* buffer, size_t size, size_t first_chunk_size = 4096,
+                  std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+            : upstream(upstream)
+            , initial_buffer(static_cast<char*>(buffer))
+            , initial_size(size)
+            , first_chunk_size(first_chunk_size)
+            , next_chunk_size(first_chunk_size)
+            , cur(initial_buffer)
+            , end(initial_buffer + size) {}
+
+    ArenaResource(const ArenaResource&) = delete;
+    ArenaResource& operator=(const ArenaResource&) = delete;
+
+    ~ArenaResource() override {
+        release();
+    }
+
+    // Frees everything allocated so far; the initial buffer is reused.
+    void release() {
+        while (chunks) {
+            Chunk* prev = chunks->prev;
+            upstream->deallocate(chunks, chunks->size, alignof(std::max_align_t));
+            chunks = prev;
+        }
+        cur = initial_buffer;
+        end = initial_buffer ? initial_buffer + initial_size : nullptr;
+        next_chunk_size = first_chunk_size;
+    }
+
+    // Grows or shrinks the most recent allocation p of old_bytes to bytes
+    // without moving it, if the current chunk has room.
+    bool resize_in_place(void* p, size_t old_bytes, size_t bytes) {
+        char* block = static_cast<char*>(p);
+        if (!cur || block + old_bytes != cur || bytes > static_cast<size_t>(end - block)) {
+            return false;
+        }
+        cur = block + bytes;
+        return true;
+    }
+
+    [[nodiscard]] std::pmr::memory_resource* upstream_resource() const {
+        return upstream;
+    }
+};
+
+// Allocator over an ArenaResource. Unlike std::pmr::polymorphic_allocator it
+// has resize_in_place, so RawMemory grows the newest buffer of the arena
+// without moving it.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    ArenaAllocator(ArenaResource* arena)
+            : arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+            : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* buf, size_t n) {
+        arena->deallocate(buf, n * sizeof(T), alignof(T));
+    }
+
+    bool resize_in_place(T* buf, size_t old_n, size_t n) {
+        return n <= SIZE_MAX / sizeof(T) && arena->resize_in_place(buf, old_n * sizeof(T), n * sizeof(T));
+    }
+
+    [[nodiscard]] ArenaResource* resource() const {
+        return arena;
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    ArenaResource* arena;
+};
+
+template <typename T>
+using ArenaVector = Vector<T, RawMemory<T, ArenaAllocator<T>>>;
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "SharedPtr.h"
+
+// SharedPtr slot that many threads may load from while others replace its
+// value, e.g. a configuration read on every request and swapped in now and
+// then. Lock-free with split reference counts:
+//
+// The slot holds RESERVED strong references to its block and packs the
+// block pointer together with a local count of how many of them readers
+// have taken. load() is a single fetch_add on that word and never touches
+// the control block on its way out, except when the local count passes
+// half of RESERVED: then the reader buys the taken references back with
+// one add to the block. Whoever replaces the value releases the references
+// no reader has taken. Nobody waits for anyone; a writer's
+// compare_exchange only retries when a reader's increment raced with it.
+// use_count() of a stored object includes the reserved references.
+//
+// The local count lives in the top 16 bits of the word, which assumes user
+// space addresses below 2^48 (x86-64 and AArch64 with 4-level page tables),
+// and fewer than RESERVED / 2 loads in flight between two buy-backs.
+template <typename T>
+class AtomicSharedPtr {
+private:
+    static_assert(sizeof(uintptr_t) == 8, "the local count is packed into a 64-bit word");
+
+    static const int LOCAL_SHIFT = 48;
+    static const uintptr_t ONE_LOCAL = uintptr_t(1) << LOCAL_SHIFT;
+    static const uintptr_t BLOCK_MASK = ONE_LOCAL - 1;
+    static const size_t RESERVED = size_t(1) << (64 - LOCAL_SHIFT);
+
+    mutable std::atomic<uintptr_t> state{0};
+
+    static inline SharedControlBlock * block_of(uintptr_t word) {
+        return reinterpret_cast<SharedControlBlock *>(word & BLOCK_MASK);
+    }
+
+    static inline size_t local_of(uintptr_t word) {
+        return word >> LOCAL_SHIFT;
+    }
+
+    // Turns the single reference desired owns into the RESERVED ones the
+    // slot holds.
+    static inline uintptr_t reserve(SharedPtr<T>& desired) {
+        SharedControlBlock * block = desired.cnt;
+        if (block) block->add_strong(RESERVED - 1);
+        return reinterpret_cast<uintptr_t>(block);
+    }
+
+    // Gives back the references of a replaced value nobody has taken,
+    // keeping keep of them for the caller.
+    static inline void release_untaken(uintptr_t word, size_t keep) {
+        SharedControlBlock * block = block_of(word);
+        if (!block) return;
+        size_t untaken = RESERVED - local_of(word) - keep;
+        if (untaken) block->release_strong(untaken);
+    }
+
+    static inline SharedPtr<T> adopt(SharedControlBlock * block) {
+        if (!block) return SharedPtr<T>();
+        return SharedPtr<T>(static_cast<T *>(block->object()), block);
+    }
+
+    // Adds the references readers have taken to block and resets the
+    // local count, if the slot still holds block.
+    inline void buy_back(SharedControlBlock * block) const {
+        uintptr_t word = state.load();
+        while (block_of(word) == block && local_of(word) >= RESERVED / 2) {
+            size_t taken = local_of(word);
+            block->add_strong(taken);
+            // The slot may have been replaced and block stored again, that
+            // is fine: the slot then holds the same block with the same
+            // count of references taken.
+            if (state.compare_exchange_weak(word, reinterpret_cast<uintptr_t>(block))) return;
+            block->release_strong(taken);
+        }
+    }
+
+public:
+    AtomicSharedPtr() = default;
+
+    explicit AtomicSharedPtr(SharedPtr<T> desired) noexcept
+            : state(reserve(desired)) {
+        desired.cnt = nullptr;
+        desired.ptr = nullptr;
+    }
+
+    AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+    AtomicSharedPtr& operator= (const AtomicSharedPtr&) = delete;
+
+    // No other thread may use the slot any more.
+    ~AtomicSharedPtr() noexcept {
+        release_untaken(state.load(), 0);
+    }
+
+    [[nodiscard]] inline SharedPtr<T> load() const noexcept {
+        uintptr_t word = state.fetch_add(ONE_LOCAL);
+        SharedControlBlock * block = block_of(word);
+        // an empty slot holds no references, its count just wraps around
+        if (!block) return SharedPtr<T>();
+        if (local_of(word) + 1 >= RESERVED / 2) buy_back(block);
+        return adopt(block);
+    }
+
+    inline void store(SharedPtr<T> desired) noexcept {
+        exchange(std::move(desired));
+    }
+
+    inline SharedPtr<T> exchange(SharedPtr<T> desired) noexcept {
+        uintptr_t word = state.exchange(reserve(desired));
+        desired.cnt = nullptr;
+        desired.ptr = nullptr;
+        release_untaken(word, 1);
+        return adopt(block_of(word));
+    }
+
+    // Replaces the value with desired if it is still the object expected
+    // points to. Otherwise loads the current value into expected.
+    inline bool compare_exchange(SharedPtr<T>& expected, SharedPtr<T> desired) noexcept {
+        uintptr_t replacement = reserve(desired);
+        uintptr_t word = state.load();
+        while (block_of(word) == expected.cnt) {
+            if (state.compare_exchange_weak(word, replacement)) {
+                desired.cnt = nullptr;
+                desired.ptr = nullptr;
+                release_untaken(word, 0);
+                return true;
+            }
+        }
+        if (desired.cnt) desired.cnt->release_strong(RESERVED - 1);
+        expected = load();
+        return false;
+    }
+
+    [[nodiscard]] static constexpr bool is_lock_free() noexcept {
+        return std::atomic<uintptr_t>::is_always_lock_free;
+    }
+};
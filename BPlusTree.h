@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+// Ordered set with the interface of RedBlackTree, but many keys per node:
+// inner nodes and leaves take about NodeBytes bytes each, so a lookup touches
+// one node per level instead of one per key comparison. Leaves are linked
+// left to right, iteration and range scans walk them sequentially.
+template <typename T, size_t NodeBytes = 256>
+class BPlusTree {
+private:
+    struct NodeBase {
+        uint32_t count = 0;
+    };
+
+    static constexpr size_t LEAF_CAPACITY = std::max<size_t>(
+            3, (NodeBytes - sizeof(NodeBase) - sizeof(void*)) / sizeof(T));
+    static constexpr size_t INNER_CAPACITY = std::max<size_t>(
+            3, (NodeBytes - sizeof(NodeBase) - sizeof(void*)) / (sizeof(T) + sizeof(void*)));
+
+    struct alignas(64) Leaf : NodeBase {
+        T keys[LEAF_CAPACITY];
+        Leaf* next = nullptr;
+    };
+
+    // keys[i] is the smallest key under children[i + 1]
+    struct alignas(64) Inner : NodeBase {
+        T keys[INNER_CAPACITY];
+        NodeBase* children[INNER_CAPACITY + 1];
+    };
+
+    // Bounds the path recorded by insert: every inner node has at least two
+    // children, so a taller tree would hold more than 2^64 keys.
+    static constexpr size_t MAX_HEIGHT = 64;
+
+    NodeBase* root = nullptr;
+    Leaf* first_leaf = nullptr;
+    size_t height = 0;  // inner levels above the leaves
+    size_t sz = 0;
+
+    // Number of keys less than val, or with or_equal not greater than it.
+    // Counted over the whole node without branches, which is cheaper than a
+    // binary search at these node sizes and vectorizes.
+    template <bool or_equal>
+    static inline size_t count_below(const T* keys, size_t count, const T& val) {
+        if constexpr (std::is_arithmetic_v<T>) {
+            size_t i = 0, result = 0;
+#ifdef __SSE2__
+            if constexpr (std::is_same_v<T, int32_t>) {
+                __m128i needle = _mm_set1_epi32(val);
+                for (; i + 4 <= count; i += 4) {
+                    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+                    if constexpr (or_equal) {
+                        __m128i greater = _mm_cmpgt_epi32(block, needle);
+                        result += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(greater)));
+                    } else {
+                        __m128i less = _mm_cmplt_epi32(block, needle);
+                        result += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+                    }
+                }
+            }
+#endif
+            for (; i < count; ++i) {
+                result += or_equal ? !(val < keys[i]) : keys[i] < val;
+            }
+            return result;
+        } else {
+            // comparisons of non-arithmetic keys are expensive, use as few as possible
+            return (or_equal ? std::upper_bound(keys, keys + count, val)
+                             : std::lower_bound(keys, keys + count, val)) - keys;
+        }
+    }
+
+    static inline NodeBase* child_for(const Inner* inner, const T& val) {
+        return inner->children[count_below<true>(inner->keys, inner->count, val)];
+    }
+
+    inline const Leaf* find_leaf(const T& val) const {
+        const NodeBase* node = root;
+        for (size_t level = height; level > 0; --level) {
+            node = child_for(static_cast<const Inner*>(node), val);
+        }
+        return static_cast<const Leaf*>(node);
+    }
+
+    static inline void insert_key(Leaf* leaf, size_t pos, const T& val) {
+        std::move_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        leaf->keys[pos] = val;
+        ++leaf->count;
+    }
+
+    static inline void insert_child(Inner* inner, size_t pos, T&& separator, NodeBase* child) {
+        std::move_backward(inner->keys + pos, inner->keys + inner->count, inner->keys + inner->count + 1);
+        std::copy_backward(inner->children + pos + 1, inner->children + inner->count + 1,
+                           inner->children + inner->count + 2);
+        inner->keys[pos] = std::move(separator);
+        inner->children[pos + 1] = child;
+        ++inner->count;
+    }
+
+    static void destroy(NodeBase* node, size_t level) {
+        if (level == 0) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        for (size_t i = 0; i <= inner->count; ++i) {
+            destroy(inner->children[i], level - 1);
+        }
+        delete inner;
+    }
+
+public:
+    class iterator {
+    private:
+        const Leaf* leaf = nullptr;
+        size_t index = 0;
+
+        friend class BPlusTree;
+
+        iterator(const Leaf* leaf, size_t index)
+                : leaf(leaf)
+                , index(index) {
+            if (leaf && index == leaf->count) {
+                this->leaf = leaf->next;
+                this->index = 0;
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        iterator() = default;
+
+        inline reference operator*() const {
+            return leaf->keys[index];
+        }
+        inline pointer operator->() const {
+            return leaf->keys + index;
+        }
+
+        inline iterator& operator++() {
+            if (++index == leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+            return *this;
+        }
+        inline iterator operator++(int) {
+            iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        inline bool operator==(const iterator& other) const {
+            return leaf == other.leaf && index == other.index;
+        }
+        inline bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    using const_iterator = iterator;
+
+    inline iterator begin() const {
+        return iterator(first_leaf, 0);
+    }
+    inline iterator end() const {
+        return iterator(nullptr, 0);
+    }
+
+    inline iterator lower_bound(const T& val) const {
+        if (empty()) return end();
+        const Leaf* leaf = find_leaf(val);
+        return iterator(leaf, count_below<false>(leaf->keys, leaf->count, val));
+    }
+
+    // Calls fn(const T&) in order for every element in [lo, hi).
+    template <typename F>
+    inline void for_each_in_range(const T& lo, const T& hi, F fn) const {
+        for (auto it = lower_bound(lo); it != end() && *it < hi; ++it) {
+            fn(*it);
+        }
+    }
+
+    [[nodiscard]] inline size_t size() const {
+        return sz;
+    }
+    [[nodiscard]] inline bool empty() const {
+        return root == nullptr;
+    }
+
+    inline bool contains(const T& val) const {
+        if (empty()) return false;
+        const Leaf* leaf = find_leaf(val);
+        size_t pos = count_below<false>(leaf->keys, leaf->count, val);
+        return pos < leaf->count && !(val < leaf->keys[pos]);
+    }
+
+    inline void insert(const T& val) {
+        if (empty()) {
+            Leaf* leaf = new Leaf;
+            insert_key(leaf, 0, val);
+            root = first_leaf = leaf;
+            sz = 1;
+            return;
+        }
+
+        // the inner nodes on the way down and the child taken in each
+        Inner* path[MAX_HEIGHT];
+        size_t child_pos[MAX_HEIGHT];
+        NodeBase* node = root;
+        for (size_t level = 0; level < height; ++level) {
+            Inner* inner = static_cast<Inner*>(node);
+            path[level] = inner;
+            child_pos[level] = count_below<true>(inner->keys, inner->count, val);
+            node = inner->children[child_pos[level]];
+        }
+        Leaf* leaf = static_cast<Leaf*>(node);
+        size_t pos = count_below<false>(leaf->keys, leaf->count, val);
+        if (pos < leaf->count && !(val < leaf->keys[pos])) return;
+        if (leaf->count < LEAF_CAPACITY) {
+            insert_key(leaf, pos, val);
+            ++sz;
+            return;
+        }
+
+        // The split goes up through the full inner nodes above the leaf and
+        // adds a root if it reaches the top. Exactly the nodes that takes are
+        // allocated before anything changes, so bad_alloc leaves the tree as
+        // it was. The spare inner nodes are linked through children[0].
+        size_t full = 0;
+        while (full < height && path[height - 1 - full]->count == INNER_CAPACITY) {
+            ++full;
+        }
+        Inner* spares = nullptr;
+        Leaf* right;
+        try {
+            for (size_t i = 0; i < full + (full == height); ++i) {
+                Inner* spare = new Inner;
+                spare->children[0] = spares;
+                spares = spare;
+            }
+            right = new Leaf;
+        } catch (...) {
+            while (spares) {
+                delete std::exchange(spares, static_cast<Inner*>(spares->children[0]));
+            }
+            throw;
+        }
+        auto take_spare = [&spares] {
+            return std::exchange(spares, static_cast<Inner*>(spares->children[0]));
+        };
+
+        size_t half = (LEAF_CAPACITY + 1) / 2;
+        std::move(leaf->keys + half, leaf->keys + leaf->count, right->keys);
+        right->count = leaf->count - half;
+        leaf->count = half;
+        right->next = leaf->next;
+        leaf->next = right;
+        if (pos >= half) {
+            insert_key(right, pos - half, val);
+        } else {
+            insert_key(leaf, pos, val);
+        }
+        ++sz;
+
+        // the key and node the next level up has to route to
+        T separator = right->keys[0];
+        NodeBase* new_child = right;
+        for (size_t level = height; level > 0; --level) {
+            Inner* inner = path[level - 1];
+            size_t child = child_pos[level - 1];
+            if (inner->count < INNER_CAPACITY) {
+                insert_child(inner, child, std::move(separator), new_child);
+                return;
+            }
+            // keys[middle] moves up, what is right of it goes to the new node
+            Inner* sibling = take_spare();
+            size_t middle = INNER_CAPACITY / 2;
+            std::move(inner->keys + middle + 1, inner->keys + inner->count, sibling->keys);
+            std::copy(inner->children + middle + 1, inner->children + inner->count + 1, sibling->children);
+            sibling->count = inner->count - middle - 1;
+            inner->count = middle;
+            T up = std::move(inner->keys[middle]);
+            if (child > middle) {
+                insert_child(sibling, child - middle - 1, std::move(separator), new_child);
+            } else {
+                insert_child(inner, child, std::move(separator), new_child);
+            }
+            separator = std::move(up);
+            new_child = sibling;
+        }
+        Inner* new_root = take_spare();
+        new_root->children[0] = root;
+        insert_child(new_root, 0, std::move(separator), new_child);
+        root = new_root;
+        ++height;
+    }
+
+    inline void clear() {
+        if (root) destroy(root, height);
+        root = first_leaf = nullptr;
+        height = sz = 0;
+    }
+
+    inline void swap(BPlusTree& other) noexcept {
+        std::swap(root, other.root);
+        std::swap(first_leaf, other.first_leaf);
+        std::swap(height, other.height);
+        std::swap(sz, other.sz);
+    }
+
+    BPlusTree() = default;
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    BPlusTree(BPlusTree&& other) noexcept {
+        swap(other);
+    }
+    BPlusTree& operator=(BPlusTree&& other) noexcept {
+        if (this != &other) {
+            clear();
+            swap(other);
+        }
+        return *this;
+    }
+
+    ~BPlusTree() {
+        clear();
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+
+#include "HashMix.h"
+#include "HashTable(Vector).h"
+
+
+// Keys are split over Shards independent open-addressing HashMaps, each
+// guarded by its own reader-writer lock and kept on its own cache lines.
+// Values are never handed out by reference: find copies them, visit and
+// update run a callback while the shard lock is held.
+template <class KeyType, class ValueType, class Hash = std::hash<KeyType>, size_t Shards = 64>
+class ConcurrentHashMap {
+private:
+    static_assert(Shards != 0 && (Shards & (Shards - 1)) == 0, "Shards must be a power of two");
+
+    static constexpr size_t CACHE_LINE = 64;
+
+    struct alignas(CACHE_LINE) Shard {
+        mutable std::shared_mutex lock;
+        HashMap<KeyType, ValueType, Hash> map;
+    };
+
+    Shard shards[Shards];
+    Hash hasher;
+
+    Shard& get_shard(const KeyType& key) {
+        return shards[get_shard_index(key)];
+    }
+    const Shard& get_shard(const KeyType& key) const {
+        return shards[get_shard_index(key)];
+    }
+
+    size_t get_shard_index(const KeyType& key) const {
+        // HashMap takes slot and fragment bits from the bottom of the mixed
+        // hash, so the shard is chosen by the top ones
+        uint64_t h = mix_hash(hasher(key));
+        return Shards == 1 ? 0 : h >> (64 - __builtin_ctzll(Shards));
+    }
+
+public:
+    explicit ConcurrentHashMap(const Hash& hasher = Hash())
+            : hasher(hasher) {
+        for (auto& shard : shards) {
+            shard.map = HashMap<KeyType, ValueType, Hash>(hasher);
+        }
+    }
+
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+    // Returns false if the key was already present.
+    bool insert(const std::pair<KeyType, ValueType>& p) {
+        Shard& shard = get_shard(p.first);
+        std::unique_lock guard(shard.lock);
+        return shard.map.insert(p).second;
+    }
+
+    template <class... Args>
+    bool try_emplace(const KeyType& key, Args&&... args) {
+        Shard& shard = get_shard(key);
+        std::unique_lock guard(shard.lock);
+        return shard.map.try_emplace(key, std::forward<Args>(args)...).second;
+    }
+
+    template <class M>
+    bool insert_or_assign(const KeyType& key, M&& obj) {
+        Shard& shard = get_shard(key);
+        std::unique_lock guard(shard.lock);
+        return shard.map.insert_or_assign(key, std::forward<M>(obj)).second;
+    }
+
+    bool erase(const KeyType& key) {
+        Shard& shard = get_shard(key);
+        std::unique_lock guard(shard.lock);
+        return shard.map.erase(key) != 0;
+    }
+
+    // Applies fn(ValueType&) to the value of key atomically with respect to
+    // every other operation on it. Returns false if the key is absent.
+    template <class F>
+    bool update(const KeyType& key, F fn) {
+        Shard& shard = get_shard(key);
+        std::unique_lock guard(shard.lock);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        fn(it->second);
+        return true;
+    }
+
+    // Same as update, but a missing key is first inserted with a value
+    // constructed from args.
+    template <class F, class... Args>
+    void upsert(const KeyType& key, F fn, Args&&... args) {
+        Shard& shard = get_shard(key);
+        std::unique_lock guard(shard.lock);
+        fn(shard.map.try_emplace(key, std::forward<Args>(args)...).first->second);
+    }
+
+    // Calls fn(const ValueType&) under the shard's shared lock.
+    template <class F>
+    bool visit(const KeyType& key, F fn) const {
+        const Shard& shard = get_shard(key);
+        std::shared_lock guard(shard.lock);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        fn(it->second);
+        return true;
+    }
+
+    std::optional<ValueType> find(const KeyType& key) const {
+        const Shard& shard = get_shard(key);
+        std::shared_lock guard(shard.lock);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    bool contains(const KeyType& key) const {
+        const Shard& shard = get_shard(key);
+        std::shared_lock guard(shard.lock);
+        return shard.map.find(key) != shard.map.end();
+    }
+
+    // Shards are visited one by one, so the result is not a snapshot of the
+    // whole map while writers are active.
+    [[nodiscard]] size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            std::shared_lock guard(shard.lock);
+            total += shard.map.size();
+        }
+        return total;
+    }
+
+    template <class F>
+    void for_each(F fn) const {
+        for (const auto& shard : shards) {
+            std::shared_lock guard(shard.lock);
+            for (const auto& kv : shard.map) {
+                fn(kv);
+            }
+        }
+    }
+
+    void clear() {
+        for (auto& shard : shards) {
+            std::unique_lock guard(shard.lock);
+            shard.map.clear();
+        }
+    }
+};
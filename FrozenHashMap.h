@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HashMix.h"
+
+
+// Read-only view of a map written by freeze() below. The file holds a
+// minimal perfect hash (hash-and-displace, CHD style) over the keys plus a
+// flat array of entries, addressed by offsets only, so it can be mmap-ed
+// by any number of processes and queried without deserializing.
+// Keys and values must be trivially copyable, and Hash must give the same
+// values in the writing and the reading process.
+template <class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+class FrozenHashMap {
+public:
+    static_assert(std::is_trivially_copyable_v<KeyType>, "frozen keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable_v<ValueType>, "frozen values must be trivially copyable");
+
+    struct Entry {
+        KeyType first;
+        ValueType second;
+    };
+
+    using const_iterator = const Entry*;
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entry_size;
+        uint64_t key_size, value_size;
+        uint64_t count, bucket_count;
+        uint64_t displacements_offset, entries_offset;
+    };
+
+    static constexpr char MAGIC[8] = {'F', 'R', 'Z', 'N', 'H', 'M', 'A', 'P'};
+    static constexpr uint32_t VERSION = 1;
+
+    // A displacement with DIRECT set stores the slot itself: buckets holding
+    // a single key take whatever slot is left, so the search never stalls
+    // on the last few free slots.
+    static constexpr uint32_t DIRECT = 1u << 31;
+    static constexpr uint32_t MAX_DISPLACEMENT = 1u << 24;
+
+    const char* base = nullptr;
+    size_t file_size = 0;
+    const Header* header = nullptr;
+    const uint32_t* displacements = nullptr;
+    const Entry* entries = nullptr;
+    Hash hasher;
+
+    static uint64_t get_slot(uint64_t hash, uint32_t displacement, uint64_t count) {
+        if (displacement & DIRECT) {
+            return displacement & ~DIRECT;
+        }
+        return mix_hash(hash + displacement * 0x9e3779b97f4a7c15ULL) % count;
+    }
+
+    static size_t align_up(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // Whether [offset, offset + n * size) lies in the file, without overflow.
+    bool fits(uint64_t offset, uint64_t n, size_t size, size_t alignment) const {
+        return offset <= file_size && offset % alignment == 0 && n <= (file_size - offset) / size;
+    }
+
+    // Checks everything find() trusts, so a truncated or corrupt file is
+    // rejected instead of read out of bounds.
+    [[nodiscard]] bool well_formed() const {
+        if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+                || header->version != VERSION
+                || header->entry_size != sizeof(Entry)
+                || header->key_size != sizeof(KeyType)
+                || header->value_size != sizeof(ValueType)
+                || header->bucket_count == 0
+                || !fits(header->displacements_offset, header->bucket_count, sizeof(uint32_t), alignof(uint32_t))
+                || !fits(header->entries_offset, header->count, sizeof(Entry), alignof(Entry))) {
+            return false;
+        }
+        auto* table = reinterpret_cast<const uint32_t*>(base + header->displacements_offset);
+        for (uint64_t b = 0; b < header->bucket_count; ++b) {
+            if ((table[b] & DIRECT) && (table[b] & ~DIRECT) >= header->count) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void unmap() {
+        if (base) {
+            munmap(const_cast<char*>(base), file_size);
+        }
+        base = nullptr;
+        header = nullptr;
+        displacements = nullptr;
+        entries = nullptr;
+    }
+
+public:
+    explicit FrozenHashMap(const std::string& path, const Hash& hasher = Hash())
+            : hasher(hasher) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("cannot open " + path);
+        }
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) {
+            close(fd);
+            throw std::runtime_error("bad frozen map " + path);
+        }
+        file_size = st.st_size;
+        void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("cannot mmap " + path);
+        }
+        base = static_cast<const char*>(mapped);
+        header = reinterpret_cast<const Header*>(base);
+        if (!well_formed()) {
+            unmap();
+            throw std::runtime_error("bad frozen map " + path);
+        }
+        displacements = reinterpret_cast<const uint32_t*>(base + header->displacements_offset);
+        entries = reinterpret_cast<const Entry*>(base + header->entries_offset);
+    }
+
+    FrozenHashMap(FrozenHashMap&& other) noexcept
+            : base(std::exchange(other.base, nullptr))
+            , file_size(other.file_size)
+            , header(std::exchange(other.header, nullptr))
+            , displacements(std::exchange(other.displacements, nullptr))
+            , entries(std::exchange(other.entries, nullptr))
+            , hasher(other.hasher) {}
+
+    FrozenHashMap& operator=(FrozenHashMap&& other) noexcept {
+        if (this != &other) {
+            unmap();
+            base = std::exchange(other.base, nullptr);
+            file_size = other.file_size;
+            header = std::exchange(other.header, nullptr);
+            displacements = std::exchange(other.displacements, nullptr);
+            entries = std::exchange(other.entries, nullptr);
+            hasher = other.hasher;
+        }
+        return *this;
+    }
+
+    FrozenHashMap(const FrozenHashMap&) = delete;
+    FrozenHashMap& operator=(const FrozenHashMap&) = delete;
+
+    ~FrozenHashMap() {
+        unmap();
+    }
+
+    // A moved-from map is empty.
+    [[nodiscard]] size_t size() const {
+        return header ? header->count : 0;
+    }
+    [[nodiscard]] bool empty() const {
+        return size() == 0;
+    }
+
+    const_iterator begin() const {
+        return entries;
+    }
+    const_iterator end() const {
+        return entries + size();
+    }
+
+    const_iterator find(const KeyType& key) const {
+        if (empty()) {
+            return end();
+        }
+        uint64_t hash = mix_hash(hasher(key));
+        uint32_t displacement = displacements[hash % header->bucket_count];
+        const Entry* entry = entries + get_slot(hash, displacement, header->count);
+        return entry->first == key ? entry : end();
+    }
+
+    [[nodiscard]] bool contains(const KeyType& key) const {
+        return find(key) != end();
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        auto it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("");
+        }
+        return it->second;
+    }
+
+    // Writes the pairs of [begin, end) to path. Keys must be distinct.
+    template <class Iter>
+    static void write(Iter begin, Iter end, const std::string& path, const Hash& hasher = Hash()) {
+        std::vector<Entry> items;
+        std::vector<uint64_t> hashes;
+        for (; begin != end; ++begin) {
+            items.push_back(Entry{begin->first, begin->second});
+            hashes.push_back(mix_hash(hasher(begin->first)));
+        }
+        uint64_t count = items.size();
+        if (count >= DIRECT) {
+            throw std::length_error("");
+        }
+
+        uint64_t bucket_count = std::max<uint64_t>(1, count / 2);
+        std::vector<std::vector<uint32_t>> buckets(bucket_count);
+        for (uint32_t i = 0; i < count; ++i) {
+            buckets[hashes[i] % bucket_count].push_back(i);
+        }
+        std::vector<uint32_t> order(bucket_count);
+        for (uint32_t b = 0; b < bucket_count; ++b) {
+            order[b] = b;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+            return buckets[lhs].size() > buckets[rhs].size();
+        });
+
+        std::vector<uint32_t> displacements(bucket_count, 0);
+        std::vector<uint32_t> slot_of(count);
+        std::vector<bool> taken(count, false);
+        std::vector<uint64_t> tried;
+        size_t next_free = 0;
+        for (uint32_t b : order) {
+            const auto& bucket = buckets[b];
+            if (bucket.size() == 1) {
+                while (taken[next_free]) {
+                    ++next_free;
+                }
+                displacements[b] = DIRECT | static_cast<uint32_t>(next_free);
+                taken[next_free] = true;
+                slot_of[bucket[0]] = next_free;
+                continue;
+            }
+            uint32_t d = 0;
+            for (;; ++d) {
+                if (d == MAX_DISPLACEMENT) {
+                    throw std::runtime_error("cannot build perfect hash, keys have equal hashes");
+                }
+                tried.clear();
+                bool fits = true;
+                for (uint32_t i : bucket) {
+                    uint64_t slot = get_slot(hashes[i], d, count);
+                    if (taken[slot] || std::find(tried.begin(), tried.end(), slot) != tried.end()) {
+                        fits = false;
+                        break;
+                    }
+                    tried.push_back(slot);
+                }
+                if (fits) {
+                    break;
+                }
+            }
+            displacements[b] = d;
+            for (uint32_t i : bucket) {
+                slot_of[i] = get_slot(hashes[i], d, count);
+                taken[slot_of[i]] = true;
+            }
+        }
+
+        // member-wise, so the zeroed padding of placed is what gets written
+        std::vector<Entry> placed(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            placed[slot_of[i]].first = items[i].first;
+            placed[slot_of[i]].second = items[i].second;
+        }
+
+        Header out{};
+        std::memcpy(out.magic, MAGIC, sizeof(MAGIC));
+        out.version = VERSION;
+        out.entry_size = sizeof(Entry);
+        out.key_size = sizeof(KeyType);
+        out.value_size = sizeof(ValueType);
+        out.count = count;
+        out.bucket_count = bucket_count;
+        out.displacements_offset = align_up(sizeof(Header), alignof(uint32_t));
+        out.entries_offset = align_up(out.displacements_offset + bucket_count * sizeof(uint32_t),
+                                      alignof(Entry));
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("cannot write " + path);
+        }
+        auto write_at = [&](size_t offset, const void* bytes, size_t n) {
+            static const char zeros[64] = {};
+            for (size_t pos = file.tellp(); pos < offset; pos += std::min<size_t>(64, offset - pos)) {
+                file.write(zeros, std::min<size_t>(64, offset - pos));
+            }
+            file.write(static_cast<const char*>(bytes), n);
+        };
+        write_at(0, &out, sizeof(out));
+        write_at(out.displacements_offset, displacements.data(), bucket_count * sizeof(uint32_t));
+        write_at(out.entries_offset, placed.data(), count * sizeof(Entry));
+        if (!file) {
+            throw std::runtime_error("cannot write " + path);
+        }
+    }
+};
+
+// Writes a FrozenHashMap file with the current contents of map, keys are
+// hashed with its hash_function(). Kept out of the map headers so that
+// they do not pull in the file and mmap headers.
+template <class Map>
+void freeze(const Map& map, const std::string& path) {
+    using Key = std::remove_cvref_t<decltype(map.begin()->first)>;
+    using Value = std::remove_cvref_t<decltype(map.begin()->second)>;
+    using Hash = std::remove_cvref_t<decltype(map.hash_function())>;
+    FrozenHashMap<Key, Value, Hash>::write(map.begin(), map.end(), path, map.hash_function());
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Spreads a hash over all 64 bits, so hashes that vary only in a few bits,
+// such as std::hash of integers (the identity), can be cut into slot,
+// fragment and shard indices. The MurmurHash3 finalizer, a bijection.
+inline uint64_t mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
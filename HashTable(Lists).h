@@ -1,144 +1,489 @@
 #include <algorithm>
+#include <cstddef>
+#include <functional>
 #include <initializer_list>
+#include <span>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <memory>
 #include <vector>
 
 
-template <class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+// Dense storage of the HashMap below: whole pairs side by side (Rows), or
+// keys and values in two separate arrays (Columns), so that passes over
+// values alone do not pull every key through the cache.
+enum class HashMapLayout {
+    Rows, Columns
+};
+
+template <class KeyType, class ValueType, HashMapLayout Layout>
+class HashMapStorage;
+
+template <class KeyType, class ValueType>
+class HashMapStorage<KeyType, ValueType, HashMapLayout::Rows> {
+private:
+    std::vector<std::pair<KeyType, ValueType>> data;
+
+public:
+    using iterator = typename std::vector<std::pair<KeyType, ValueType>>::iterator;
+    using const_iterator = typename std::vector<std::pair<KeyType, ValueType>>::const_iterator;
+
+    [[nodiscard]] size_t size() const {
+        return data.size();
+    }
+
+    iterator begin() {
+        return data.begin();
+    }
+    const_iterator begin() const {
+        return data.cbegin();
+    }
+    iterator end() {
+        return data.end();
+    }
+    const_iterator end() const {
+        return data.cend();
+    }
+
+    const KeyType& key(size_t i) const {
+        return data[i].first;
+    }
+    ValueType& value(size_t i) {
+        return data[i].second;
+    }
+    const ValueType& value(size_t i) const {
+        return data[i].second;
+    }
+
+    template <class K, class... Args>
+    void emplace_back(K&& key, Args&&... args) {
+        data.emplace_back(
+                std::piecewise_construct,
+                std::forward_as_tuple(std::forward<K>(key)),
+                std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+    template <class P>
+    void push_back(P&& p) {
+        data.push_back(std::forward<P>(p));
+    }
+
+    void move_back_to(size_t i) {
+        data[i] = std::move(data.back());
+    }
+    void pop_back() {
+        data.pop_back();
+    }
+    void clear() {
+        data.clear();
+    }
+};
+
+template <class KeyType, class ValueType>
+class HashMapStorage<KeyType, ValueType, HashMapLayout::Columns> {
+private:
+    std::vector<KeyType> key_data;
+    std::vector<ValueType> value_data;
+
+    // Dereferencing gives a proxy holding references into both columns, so
+    // iterate with "auto&&" or "const auto&" rather than "auto&".
+    template <bool Const>
+    class column_iterator {
+    private:
+        using storage_ptr = std::conditional_t<Const, const HashMapStorage*, HashMapStorage*>;
+        using value_ref = std::conditional_t<Const, const ValueType&, ValueType&>;
+
+        size_t index;
+        storage_ptr storage;
+
+    public:
+        struct reference {
+            const KeyType& first;
+            value_ref second;
+        };
+
+        struct pointer {
+            reference ref;
+
+            reference* operator->() {
+                return &ref;
+            }
+        };
+
+        explicit column_iterator(size_t index = 0, storage_ptr storage = nullptr)
+                : index(index)
+                , storage(storage) {}
+
+        operator column_iterator<true>() const {
+            return column_iterator<true>(index, storage);
+        }
+
+        column_iterator& operator++() {
+            ++index;
+            return *this;
+        }
+        column_iterator operator++(int) {
+            column_iterator copied = *this;
+            ++index;
+            return copied;
+        }
+        column_iterator& operator--() {
+            --index;
+            return *this;
+        }
+
+        column_iterator operator+(size_t shift) const {
+            return column_iterator(index + shift, storage);
+        }
+        ptrdiff_t operator-(const column_iterator& other) const {
+            return static_cast<ptrdiff_t>(index) - static_cast<ptrdiff_t>(other.index);
+        }
+
+        bool operator==(const column_iterator& other) const {
+            return index == other.index && storage == other.storage;
+        }
+        bool operator!=(const column_iterator& other) const {
+            return !(*this == other);
+        }
+
+        reference operator*() const {
+            return {storage->key_data[index], storage->value_data[index]};
+        }
+        pointer operator->() const {
+            return {**this};
+        }
+    };
+
+public:
+    using iterator = column_iterator<false>;
+    using const_iterator = column_iterator<true>;
+
+    [[nodiscard]] size_t size() const {
+        return key_data.size();
+    }
+
+    iterator begin() {
+        return iterator(0, this);
+    }
+    const_iterator begin() const {
+        return const_iterator(0, this);
+    }
+    iterator end() {
+        return iterator(size(), this);
+    }
+    const_iterator end() const {
+        return const_iterator(size(), this);
+    }
+
+    const KeyType& key(size_t i) const {
+        return key_data[i];
+    }
+    ValueType& value(size_t i) {
+        return value_data[i];
+    }
+    const ValueType& value(size_t i) const {
+        return value_data[i];
+    }
+
+    std::span<const KeyType> keys() const {
+        return key_data;
+    }
+    std::span<ValueType> values() {
+        return value_data;
+    }
+    std::span<const ValueType> values() const {
+        return value_data;
+    }
+
+    template <class K, class... Args>
+    void emplace_back(K&& key, Args&&... args) {
+        key_data.emplace_back(std::forward<K>(key));
+        try {
+            value_data.emplace_back(std::forward<Args>(args)...);
+        } catch (...) {
+            key_data.pop_back();
+            throw;
+        }
+    }
+    template <class P>
+    void push_back(P&& p) {
+        emplace_back(std::forward<P>(p).first, std::forward<P>(p).second);
+    }
+
+    void move_back_to(size_t i) {
+        key_data[i] = std::move(key_data.back());
+        value_data[i] = std::move(value_data.back());
+    }
+    void pop_back() {
+        key_data.pop_back();
+        value_data.pop_back();
+    }
+    void clear() {
+        key_data.clear();
+        value_data.clear();
+    }
+};
+
+template <class KeyType, class ValueType, class Hash = std::hash<KeyType>,
+          class KeyEqual = std::equal_to<KeyType>, HashMapLayout Layout = HashMapLayout::Rows>
 class HashMap {
 private:
     using key_value_pair = std::pair<KeyType, ValueType>;
+    using storage_t = HashMapStorage<KeyType, ValueType, Layout>;
 
 public:
-    using iterator = typename std::vector<key_value_pair>::iterator;
-    using const_iterator = typename std::vector<key_value_pair>::const_iterator;
+    using iterator = typename storage_t::iterator;
+    using const_iterator = typename storage_t::const_iterator;
 
 private:
-    std::vector<key_value_pair> data;
-    std::vector<std::vector<size_t>> index_data;
+    storage_t data;
+    // Bucket chains are intrusive: heads[b] is the first position in data
+    // of bucket b and next[i] follows data[i], NONE ends a chain.
+    static constexpr size_t NONE = static_cast<size_t>(-1);
+    std::vector<size_t> heads;
+    std::vector<size_t> next;
     Hash hasher;
+    KeyEqual key_equal;
+
+    // Heterogeneous lookup is enabled only when both Hash and KeyEqual
+    // declare is_transparent, as with std::unordered_map.
+    template <class K, class = void>
+    struct is_transparent_key : std::false_type {};
+    template <class K>
+    struct is_transparent_key<K, std::void_t<
+            typename Hash::is_transparent,
+            typename KeyEqual::is_transparent>> : std::true_type {};
+
+    template <class K>
+    using enable_if_transparent = std::enable_if_t<is_transparent_key<K>::value>;
+
+    template <class K>
+    size_t get_hash(const K& key) const {
+        return hasher(key) % heads.size();
+    }
 
-    size_t get_hash(const KeyType& key) const {
-        return hasher(key) % index_data.size();
+    // Returns the position of key in data, or data.size() if it is absent.
+    template <class K>
+    size_t find_index(const K& key, size_t hash) const {
+        for (size_t it = heads[hash]; it != NONE; it = next[it]) {
+            if (key_equal(data.key(it), key)) {
+                return it;
+            }
+        }
+        return data.size();
+    }
+
+    // Returns the link that points to position index in its bucket chain.
+    size_t& find_link(size_t index, size_t hash) {
+        size_t* link = &heads[hash];
+        while (*link != index) {
+            link = &next[*link];
+        }
+        return *link;
     }
 
     void reallocate() {
-        if (data.size() >= index_data.size() * 2) {
-            size_t new_size = index_data.size() * 2;
-            index_data.clear();
-            index_data.resize(new_size);
+        if (data.size() >= heads.size() * 2) {
+            heads.assign(heads.size() * 2, NONE);
             for (size_t i = 0; i < data.size(); ++i) {
-                index_data[get_hash(data[i].first)].push_back(i);
+                size_t hash = get_hash(data.key(i));
+                next[i] = heads[hash];
+                heads[hash] = i;
             }
         }
     }
 
+    template <class K, class... Args>
+    std::pair<iterator, bool> try_emplace_impl(K&& key, Args&&... args) {
+        size_t hash = get_hash(key);
+        size_t index = find_index(key, hash);
+        if (index != data.size()) {
+            return {data.begin() + index, false};
+        }
+        data.emplace_back(std::forward<K>(key), std::forward<Args>(args)...);
+        next.push_back(heads[hash]);
+        heads[hash] = index;
+        reallocate();
+        return {data.begin() + index, true};
+    }
+
+    template <class P>
+    std::pair<iterator, bool> insert_impl(P&& p) {
+        size_t hash = get_hash(p.first);
+        size_t index = find_index(p.first, hash);
+        if (index != data.size()) {
+            return {data.begin() + index, false};
+        }
+        data.push_back(std::forward<P>(p));
+        next.push_back(heads[hash]);
+        heads[hash] = index;
+        reallocate();
+        return {data.begin() + index, true};
+    }
+
 public:
-    explicit HashMap(const Hash& hasher = Hash())
-            : data(0)
-            , index_data(1)
-            , hasher(hasher) {}
+    explicit HashMap(const Hash& hasher = Hash(), const KeyEqual& key_equal = KeyEqual())
+            : heads(1, NONE)
+            , hasher(hasher)
+            , key_equal(key_equal) {}
 
     template<class Forward_Iter>
-    HashMap(Forward_Iter begin, Forward_Iter end, const Hash& hasher = Hash())
-            : HashMap(hasher) {
+    HashMap(Forward_Iter begin, Forward_Iter end, const Hash& hasher = Hash(),
+            const KeyEqual& key_equal = KeyEqual())
+            : HashMap(hasher, key_equal) {
         for (; begin != end; ++begin) {
             insert(*begin);
         }
     }
 
-    HashMap(std::initializer_list<std::pair<KeyType, ValueType>> l, const Hash& hasher = Hash())
-            :HashMap(l.begin(), l.end(), hasher) {}
+    HashMap(std::initializer_list<std::pair<KeyType, ValueType>> l, const Hash& hasher = Hash(),
+            const KeyEqual& key_equal = KeyEqual())
+            :HashMap(l.begin(), l.end(), hasher, key_equal) {}
 
     [[nodiscard]] size_t size() const {
         return data.size();
     }
     [[nodiscard]] bool empty() const {
-        return data.empty();
+        return data.size() == 0;
     }
     const Hash& hash_function() const {
         return hasher;
     }
+    const KeyEqual& key_eq() const {
+        return key_equal;
+    }
 
     iterator begin() {
         return data.begin();
     }
     const_iterator begin() const {
-        return data.cbegin();
+        return data.begin();
     }
     iterator end() {
         return data.end();
     }
     const_iterator end() const {
-        return data.cend();
+        return data.end();
+    }
+
+    // Contiguous columns for vectorized passes, only with the Columns layout.
+    // values() may be written through, keys must stay unchanged.
+    std::span<const KeyType> keys() const requires (Layout == HashMapLayout::Columns) {
+        return data.keys();
+    }
+    std::span<ValueType> values() requires (Layout == HashMapLayout::Columns) {
+        return data.values();
+    }
+    std::span<const ValueType> values() const requires (Layout == HashMapLayout::Columns) {
+        return data.values();
     }
 
     iterator find(const KeyType& key) {
-        for (auto it : index_data[get_hash(key)]) {
-            if (data[it].first == key) {
-                return data.begin() + it;
-            }
-        }
-        return data.end();
+        return data.begin() + find_index(key, get_hash(key));
     }
 
     const_iterator find(const KeyType& key) const {
-        for (auto it : index_data[get_hash(key)]) {
-            if (data[it].first == key) {
-                return data.begin() + it;
-            }
-        }
-        return data.cend();
+        return data.begin() + find_index(key, get_hash(key));
+    }
+
+    template <class K, class = enable_if_transparent<K>>
+    iterator find(const K& key) {
+        return data.begin() + find_index(key, get_hash(key));
+    }
+
+    template <class K, class = enable_if_transparent<K>>
+    const_iterator find(const K& key) const {
+        return data.begin() + find_index(key, get_hash(key));
     }
 
     void erase(const KeyType& key) {
-        if (find(key) == end()) {
+        size_t hash_it = get_hash(key);
+        size_t index_it = find_index(key, hash_it);
+        if (index_it == data.size()) {
             return;
         }
-        auto it = find(key);
-        size_t hash_it = get_hash(key);
-        size_t hash_end = get_hash(data.back().first);
-        size_t index_it = std::distance(data.begin(), it);
         size_t index_end = data.size() - 1;
 
-        swap(data[index_it], data[index_end]);
+        find_link(index_it, hash_it) = next[index_it];
+        if (index_it != index_end) {
+            find_link(index_end, get_hash(data.key(index_end))) = index_it;
+            next[index_it] = next[index_end];
+            data.move_back_to(index_it);
+        }
         data.pop_back();
+        next.pop_back();
+    }
 
-        for (auto& index : index_data[hash_it]) {
-            if (index == index_it) {
-                std::swap(index, index_data[hash_it].back());
-                break;
-            }
-        }
-        index_data[hash_it].pop_back();
+    std::pair<iterator, bool> insert(const key_value_pair& p) {
+        return insert_impl(p);
+    }
+    std::pair<iterator, bool> insert(key_value_pair&& p) {
+        return insert_impl(std::move(p));
+    }
+
+    // Unlike the other insertions the pair is built before probing, since
+    // the key is only known after construction.
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return insert_impl(key_value_pair(std::forward<Args>(args)...));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return try_emplace_impl(key, std::forward<Args>(args)...);
+    }
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return try_emplace_impl(std::move(key), std::forward<Args>(args)...);
     }
 
-    void insert(const key_value_pair& p) {
-        if (find(p.first) == data.end()) {
-            data.push_back(p);
-            index_data[get_hash(p.first)].push_back(data.size() - 1);
-            reallocate();
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = try_emplace_impl(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = try_emplace_impl(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
         }
+        return result;
     }
 
     const ValueType& at(const KeyType& key) const {
-        if (find(key) != data.end()) {
-            return find(key)->second;
+        size_t index = find_index(key, get_hash(key));
+        if (index != data.size()) {
+            return data.value(index);
+        } else {
+            throw std::out_of_range("");
+        }
+    }
+
+    template <class K, class = enable_if_transparent<K>>
+    const ValueType& at(const K& key) const {
+        size_t index = find_index(key, get_hash(key));
+        if (index != data.size()) {
+            return data.value(index);
         } else {
             throw std::out_of_range("");
         }
     }
 
     ValueType& operator[](const KeyType& key) {
-        insert({key, ValueType()});
-        return find(key)->second;
+        return try_emplace_impl(key).first->second;
+    }
+    ValueType& operator[](KeyType&& key) {
+        return try_emplace_impl(std::move(key)).first->second;
     }
 
     void clear() {
         data.clear();
-        index_data.clear();
-        index_data.resize(1);
+        next.clear();
+        heads.assign(1, NONE);
     }
 };
@@ -1,17 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <new>
+#include <span>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "HashMix.h"
+
 
-template <class KeyType, class ValueType, class Hash = std::hash<KeyType>>
+template <class KeyType, class ValueType, class Hash = std::hash<KeyType>,
+          class KeyEqual = std::equal_to<KeyType>>
 class HashMap {
 private:
     using key_value_t = typename std::pair<KeyType, ValueType>;
     size_t initial_size = 1;
 
-    enum class Status {
-        OK, DELETED, EMPTY
+    // One control byte per slot: EMPTY and DELETED have the high bit set,
+    // a full slot stores the low 7 bits of the key hash.
+    using ctrl_t = int8_t;
+    static constexpr ctrl_t EMPTY = -128, DELETED = -2;
+
+    static bool is_full(ctrl_t c) {
+        return c >= 0;
+    }
+
+    // A window of GROUP_WIDTH consecutive control bytes, checked at once.
+    // Bit i of every returned mask refers to the slot (pos + i) % capacity.
+    static constexpr size_t GROUP_WIDTH = 16;
+
+    struct Group {
+#ifdef __SSE2__
+        __m128i ctrl;
+
+        explicit Group(const ctrl_t* pos)
+                : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+        [[nodiscard]] uint32_t match(ctrl_t h2) const {
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+        }
+#else
+        const ctrl_t* ctrl;
+
+        explicit Group(const ctrl_t* pos)
+                : ctrl(pos) {}
+
+        [[nodiscard]] uint32_t match(ctrl_t h2) const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+                mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+            }
+            return mask;
+        }
+#endif
+        [[nodiscard]] uint32_t match_empty() const {
+            return match(EMPTY);
+        }
     };
 
 public:
@@ -26,7 +80,7 @@ public:
                 , map(map) {}
 
         iterator& operator++() {
-            while (++index != map->data.size() && map->status[index] != Status::OK) {}
+            while (++index != map->slot_count() && !map->is_live(index)) {}
             return *this;
         }
 
@@ -45,11 +99,11 @@ public:
         }
 
         key_value_t& operator*() const {
-            return reinterpret_cast<key_value_t&>(map->data[index]);
+            return map->slot(index);
         }
 
         key_value_t* operator->() const {
-            return reinterpret_cast<key_value_t*>(&map->data[index]);
+            return &map->slot(index);
         }
     };
 
@@ -64,7 +118,7 @@ public:
                 , map(map) {}
 
         const_iterator& operator++() {
-            while (++index != map->data.size() && map->status[index] != Status::OK) {}
+            while (++index != map->slot_count() && !map->is_live(index)) {}
             return *this;
         }
 
@@ -83,159 +137,675 @@ public:
         }
 
         const key_value_t& operator*() const {
-            return reinterpret_cast<const key_value_t&>(map->data[index]);
+            return map->slot(index);
         }
 
         const key_value_t* operator->() const {
-            return reinterpret_cast<const key_value_t*>(&map->data[index]);
+            return &map->slot(index);
         }
     };
 
 public:
-    std::vector<key_value_t> data;
-    std::vector<Status> status;
-    size_t sz = 0, real_sz = initial_size;
+    // Raw storage for one pair, it is alive only while the slot's control
+    // byte is full, so values can be constructed in place.
+    struct Slot {
+        alignas(key_value_t) unsigned char bytes[sizeof(key_value_t)];
+
+        key_value_t& operator*() {
+            return *std::launder(reinterpret_cast<key_value_t*>(bytes));
+        }
+        const key_value_t& operator*() const {
+            return *std::launder(reinterpret_cast<const key_value_t*>(bytes));
+        }
+        key_value_t* operator->() {
+            return &**this;
+        }
+        const key_value_t* operator->() const {
+            return &**this;
+        }
+    };
+
+    // All three are empty until the first insertion, so constructing and
+    // moving a map never allocates.
+    std::vector<Slot> data;
+    // data.size() + GROUP_WIDTH bytes, the tail mirrors the head so that
+    // a group can be loaded at any position without wrapping
+    std::vector<ctrl_t> ctrl;
+    // The current table is kept in Robin Hood order without tombstones.
+    // dist[i] is how far slot i is from its home slot, distances that do not
+    // fit are stored as DIST_SATURATED and recomputed from the hash.
+    // probe_limit bounds every distance, so lookups stop after it.
+    static constexpr uint8_t DIST_SATURATED = 255;
+    std::vector<uint8_t> dist;
+    size_t probe_limit = 0;
+    float max_lf = 0.5f;
+    size_t sz = 0, real_sz = 0;
     Hash hasher;
+    KeyEqual key_equal;
+
+    // Tables with at least INCREMENTAL_REHASH_MIN slots grow incrementally:
+    // the previous table is kept in old_data / old_ctrl and every insert or
+    // erase moves MIGRATION_STEP of its slots into the new one. Migrated and
+    // erased old slots become DELETED so the old probe sequences stay intact,
+    // this is the only place tombstones are used.
+    // Iterator indices past data.size() refer to the old table.
+    static constexpr size_t INCREMENTAL_REHASH_MIN = 1 << 12;
+    static constexpr size_t MIGRATION_STEP = 8;
+
+    std::vector<Slot> old_data;
+    std::vector<ctrl_t> old_ctrl;
+    size_t migrated = 0;
+
+    [[nodiscard]] bool migrating() const {
+        return !old_data.empty();
+    }
 
-    size_t get_hash(const KeyType& key, size_t mod) const {
-        return hasher(key) % mod;
+    [[nodiscard]] size_t slot_count() const {
+        return data.size() + old_data.size();
     }
 
-    size_t get_index(
-            const std::vector<key_value_t>& target_data,
-            const std::vector<Status>& target_status,
-            const KeyType& key) const {
-        size_t pos = get_hash(key, target_data.size());
-        for (size_t i = pos; i < target_data.size(); ++i) {
-            if (target_data[i].first == key || target_status[i] == Status::EMPTY) {
-                return i;
+    [[nodiscard]] bool is_live(size_t index) const {
+        return index < data.size() ? is_full(ctrl[index]) : is_full(old_ctrl[index - data.size()]);
+    }
+
+    key_value_t& slot(size_t index) {
+        return index < data.size() ? *data[index] : *old_data[index - data.size()];
+    }
+    const key_value_t& slot(size_t index) const {
+        return index < data.size() ? *data[index] : *old_data[index - data.size()];
+    }
+
+    // Heterogeneous lookup is enabled only when both Hash and KeyEqual
+    // declare is_transparent, as with std::unordered_map.
+    template <class K, class = void>
+    struct is_transparent_key : std::false_type {};
+    template <class K>
+    struct is_transparent_key<K, std::void_t<
+            typename Hash::is_transparent,
+            typename KeyEqual::is_transparent>> : std::true_type {};
+
+    template <class K>
+    using enable_if_transparent = std::enable_if_t<is_transparent_key<K>::value>;
+
+    template <class K>
+    size_t get_hash(const K& key) const {
+        return mix_hash(hasher(key));
+    }
+
+    static ctrl_t get_h2(size_t hash) {
+        return static_cast<ctrl_t>(hash & 0x7F);
+    }
+
+    static void set_ctrl(std::vector<ctrl_t>& target_ctrl, size_t i, ctrl_t c) {
+        size_t cap = target_ctrl.size() - GROUP_WIDTH;
+        for (; i < target_ctrl.size(); i += cap) {
+            target_ctrl[i] = c;
+        }
+    }
+
+    static void destroy_all(std::vector<Slot>& target_data, const std::vector<ctrl_t>& target_ctrl) {
+        for (size_t i = 0; i < target_data.size(); ++i) {
+            if (is_full(target_ctrl[i])) {
+                target_data[i]->~key_value_t();
             }
         }
-        for (size_t i = 0; i < pos; ++i) {
-            if (target_data[i].first == key || target_status[i] == Status::EMPTY) {
-                return i;
+    }
+
+    // Returns the slot holding key, or target_data.size() if it is absent.
+    // Only the first limit + 1 positions of the probe sequence are checked.
+    template <class K>
+    size_t get_index(
+            const std::vector<Slot>& target_data,
+            const std::vector<ctrl_t>& target_ctrl,
+            const K& key,
+            size_t hash,
+            size_t limit) const {
+        // capacities are powers of two, so "% cap" is "& mask"
+        size_t cap = target_data.size(), cap_mask = cap - 1;
+        size_t pos = (hash >> 7) & cap_mask;
+        for (size_t probed = 0; probed <= limit && probed < cap; probed += GROUP_WIDTH) {
+            Group group(&target_ctrl[pos]);
+            for (uint32_t mask = group.match(get_h2(hash)); mask; mask &= mask - 1) {
+                size_t i = (pos + __builtin_ctz(mask)) & cap_mask;
+                if (key_equal(target_data[i]->first, key)) {
+                    return i;
+                }
             }
+            if (group.match_empty()) {
+                break;
+            }
+            pos = (pos + GROUP_WIDTH) & cap_mask;
         }
-        return sz;
+        return cap;
+    }
+
+    [[nodiscard]] size_t get_distance(size_t index) const {
+        if (dist[index] != DIST_SATURATED) {
+            return dist[index];
+        }
+        return (index - (get_hash(data[index]->first) >> 7)) & (data.size() - 1);
+    }
+
+    void set_distance(size_t index, size_t d) {
+        dist[index] = static_cast<uint8_t>(std::min<size_t>(d, DIST_SATURATED));
+        probe_limit = std::max(probe_limit, d);
+    }
+
+    // Moves the full slot from into the free slot to of the current table.
+    void move_slot(size_t from, size_t to, size_t new_distance) {
+        new (data[to].bytes) key_value_t(std::move(*data[from]));
+        data[from]->~key_value_t();
+        set_ctrl(ctrl, to, ctrl[from]);
+        set_distance(to, new_distance);
+    }
+
+    // Robin Hood placement: the new key goes before the first entry that is
+    // closer to its home than the key would be, and that entry and the rest
+    // of its run shift one slot forward. This keeps every run ordered by
+    // home slot. Returns the freed slot, its control byte is left EMPTY
+    // until occupy() is called.
+    size_t make_room(size_t hash) {
+        size_t cap_mask = data.size() - 1;
+        size_t pos = (hash >> 7) & cap_mask, d = 0;
+        while (is_full(ctrl[pos]) && get_distance(pos) >= d) {
+            pos = (pos + 1) & cap_mask;
+            ++d;
+        }
+        size_t last = pos;
+        while (is_full(ctrl[last])) {
+            last = (last + 1) & cap_mask;
+        }
+        for (; last != pos; last = (last - 1) & cap_mask) {
+            size_t prev = (last - 1) & cap_mask;
+            move_slot(prev, last, get_distance(prev) + 1);
+        }
+        set_ctrl(ctrl, pos, EMPTY);
+        set_distance(pos, d);
+        return pos;
+    }
+
+    // Backward-shift deletion: the entries after the emptied slot that are
+    // not at their home move one slot back, so no tombstone is left.
+    void close_hole(size_t index) {
+        size_t cap_mask = data.size() - 1;
+        for (size_t next = (index + 1) & cap_mask;
+             is_full(ctrl[next]) && get_distance(next) != 0;
+             index = next, next = (next + 1) & cap_mask) {
+            move_slot(next, index, get_distance(next) - 1);
+        }
+        set_ctrl(ctrl, index, EMPTY);
+    }
+
+    // Moves the pair from a full slot of another table into the current one.
+    void move_in(Slot& from, size_t hash) {
+        size_t index = make_room(hash);
+        new (data[index].bytes) key_value_t(std::move(*from));
+        from->~key_value_t();
+        set_ctrl(ctrl, index, get_h2(hash));
+        ++real_sz;
     }
 
     void rehash(size_t new_size) {
-        std::vector<key_value_t> new_data(new_size);
-        std::vector<Status> new_status(new_size, Status::EMPTY);
-        for (size_t i = 0; i < data.size(); ++i) {
-            if (status[i] == Status::OK) {
-                size_t new_i = get_index(new_data, new_status, data[i].first);
-                new_data[new_i] = std::move(data[i]);
-                new_status[new_i] = Status::OK;
+        std::vector<Slot> old(new_size);
+        std::vector<ctrl_t> old_status(new_size + GROUP_WIDTH, EMPTY);
+        data.swap(old);
+        ctrl.swap(old_status);
+        dist.assign(new_size, 0);
+        real_sz = 0;
+        probe_limit = 0;
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (is_full(old_status[i])) {
+                move_in(old[i], get_hash(old[i]->first));
             }
         }
-        data = std::move(new_data);
-        status = std::move(new_status);
     }
 
-public:
-    explicit HashMap(const Hash& hasher = Hash())
-            : hasher(hasher) {
-        clear();
+    // Returns the slot_count()-based index of key, or slot_count() if absent.
+    template <class K>
+    size_t find_index(const K& key, size_t hash) const {
+        size_t index = get_index(data, ctrl, key, hash, probe_limit);
+        if (index != data.size()) {
+            return index;
+        }
+        if (migrating()) {
+            index = get_index(old_data, old_ctrl, key, hash, old_data.size());
+            if (index != old_data.size()) {
+                return data.size() + index;
+            }
+        }
+        return slot_count();
+    }
+
+    void migrate(size_t steps) {
+        for (; steps != 0 && migrated != old_data.size(); --steps, ++migrated) {
+            if (is_full(old_ctrl[migrated])) {
+                move_in(old_data[migrated], get_hash(old_data[migrated]->first));
+                set_ctrl(old_ctrl, migrated, DELETED);
+            }
+        }
+        if (migrating() && migrated == old_data.size()) {
+            std::vector<Slot>().swap(old_data);
+            std::vector<ctrl_t>().swap(old_ctrl);
+            migrated = 0;
+        }
+    }
+
+    void grow() {
+        if (migrating()) {
+            migrate(old_data.size());
+        }
+        if (data.size() < INCREMENTAL_REHASH_MIN) {
+            rehash(2 * std::max(data.size(), initial_size));
+            return;
+        }
+        old_data = std::move(data);
+        old_ctrl = std::move(ctrl);
+        data = std::vector<Slot>(2 * old_data.size());
+        ctrl.assign(data.size() + GROUP_WIDTH, EMPTY);
+        dist.assign(data.size(), 0);
+        real_sz = 0;
+        probe_limit = 0;
+        migrated = 0;
+    }
+
+    // Batched lookups hash each key and prefetch its home group BATCH_CHUNK
+    // keys ahead of probing it, so the cache misses of different keys
+    // overlap instead of forming one chain.
+    static constexpr size_t BATCH_CHUNK = 16;
+
+    void prefetch_home(size_t hash) const {
+        if (data.empty()) {
+            return;
+        }
+        size_t pos = (hash >> 7) & (data.size() - 1);
+        __builtin_prefetch(&ctrl[pos]);
+        __builtin_prefetch(&data[pos]);
+        if (migrating()) {
+            pos = (hash >> 7) & (old_data.size() - 1);
+            __builtin_prefetch(&old_ctrl[pos]);
+            __builtin_prefetch(&old_data[pos]);
+        }
     }
 
+    template <class F>
+    void for_each_batch_index(std::span<const KeyType> keys, F on_index) const {
+        size_t hashes[BATCH_CHUNK];
+        size_t ahead = std::min(BATCH_CHUNK, keys.size());
+        for (size_t i = 0; i < ahead; ++i) {
+            hashes[i] = get_hash(keys[i]);
+            prefetch_home(hashes[i]);
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            size_t hash = hashes[i % BATCH_CHUNK];
+            if (i + BATCH_CHUNK < keys.size()) {
+                hashes[i % BATCH_CHUNK] = get_hash(keys[i + BATCH_CHUNK]);
+                prefetch_home(hashes[i % BATCH_CHUNK]);
+            }
+            on_index(i, find_index(keys[i], hash));
+        }
+    }
+
+    // Whether p points into one of the tables. Inserting moves entries, so
+    // arguments that refer to a mapped value of this map are copied first.
+    [[nodiscard]] bool in_storage(const void* p) const {
+        auto inside = [p](const std::vector<Slot>& slots) {
+            std::less_equal<const void*> le;
+            return !slots.empty() && le(slots.data(), p) && !le(slots.data() + slots.size(), p);
+        };
+        return inside(data) || inside(old_data);
+    }
+
+    // Makes room for an absent key: advances an incremental rehash, grows
+    // the table if needed and returns a freed slot of the current table.
+    // Entries may move, so the key must have been probed for (and its
+    // arguments copied out of the table) beforehand. The caller constructs
+    // the pair there and calls occupy(), or abandon() if that throws.
+    size_t prepare_insert(size_t hash) {
+        migrate(MIGRATION_STEP);
+        if (static_cast<float>(real_sz + 1) > max_lf * static_cast<float>(data.size())) {
+            grow();
+        }
+        return make_room(hash);
+    }
+
+    void occupy(size_t index, size_t hash) {
+        ++real_sz;
+        ++sz;
+        set_ctrl(ctrl, index, get_h2(hash));
+    }
+
+    void abandon(size_t index) {
+        close_hole(index);
+    }
+
+    template <class K, class... Args>
+    std::pair<iterator, bool> try_emplace_impl(K&& key, Args&&... args) {
+        size_t hash = get_hash(key);
+        size_t index = find_index(key, hash);
+        if (index != slot_count()) {
+            return {iterator(index, this), false};
+        }
+        if (in_storage(std::addressof(key)) || (in_storage(std::addressof(args)) || ...)) {
+            return try_emplace_impl(KeyType(key), ValueType(std::forward<Args>(args)...));
+        }
+        index = prepare_insert(hash);
+        try {
+            new (data[index].bytes) key_value_t(
+                    std::piecewise_construct,
+                    std::forward_as_tuple(std::forward<K>(key)),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            abandon(index);
+            throw;
+        }
+        occupy(index, hash);
+        return {iterator(index, this), true};
+    }
+
+    template <class P>
+    std::pair<iterator, bool> insert_impl(P&& p) {
+        size_t hash = get_hash(p.first);
+        size_t index = find_index(p.first, hash);
+        if (index != slot_count()) {
+            return {iterator(index, this), false};
+        }
+        if (in_storage(std::addressof(p))) {
+            return insert_impl(key_value_t(p));
+        }
+        index = prepare_insert(hash);
+        try {
+            new (data[index].bytes) key_value_t(std::forward<P>(p));
+        } catch (...) {
+            abandon(index);
+            throw;
+        }
+        occupy(index, hash);
+        return {iterator(index, this), true};
+    }
+
+public:
+    explicit HashMap(const Hash& hasher = Hash(), const KeyEqual& key_equal = KeyEqual())
+            : hasher(hasher)
+            , key_equal(key_equal) {}
+
     template<typename Iter>
-    HashMap(Iter begin, Iter end, const Hash& hasher = Hash())
-            : HashMap(hasher) {
+    HashMap(Iter begin, Iter end, const Hash& hasher = Hash(), const KeyEqual& key_equal = KeyEqual())
+            : HashMap(hasher, key_equal) {
         for (; begin != end; ++begin) {
             insert(*begin);
         }
     }
 
-    HashMap (const std::initializer_list<key_value_t>& l, const Hash& hasher = Hash())
-            : HashMap(l.begin(), l.end(), hasher) {}
+    HashMap (const std::initializer_list<key_value_t>& l, const Hash& hasher = Hash(),
+             const KeyEqual& key_equal = KeyEqual())
+            : HashMap(l.begin(), l.end(), hasher, key_equal) {}
+
+    // Keeps other's max load factor and sizes the table for its entries up
+    // front, so the copy neither grows nor rehashes incrementally.
+    HashMap(const HashMap& other)
+            : HashMap(other.hasher, other.key_equal) {
+        max_lf = other.max_lf;
+        reserve(other.size());
+        for (const key_value_t& elem : other) {
+            insert(elem);
+        }
+    }
+
+    HashMap(HashMap&& other) noexcept
+            : HashMap(other.hasher, other.key_equal) {
+        swap(other);
+    }
+
+    HashMap& operator=(HashMap other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~HashMap() {
+        destroy_all(data, ctrl);
+        destroy_all(old_data, old_ctrl);
+    }
+
+    void swap(HashMap& other) noexcept {
+        std::swap(data, other.data);
+        std::swap(ctrl, other.ctrl);
+        std::swap(dist, other.dist);
+        std::swap(probe_limit, other.probe_limit);
+        std::swap(max_lf, other.max_lf);
+        std::swap(sz, other.sz);
+        std::swap(real_sz, other.real_sz);
+        std::swap(hasher, other.hasher);
+        std::swap(key_equal, other.key_equal);
+        std::swap(old_data, other.old_data);
+        std::swap(old_ctrl, other.old_ctrl);
+        std::swap(migrated, other.migrated);
+    }
 
     iterator begin() {
-        if (status[0] == Status::OK) {
+        if (slot_count() == 0 || is_live(0)) {
             return iterator(0, this);
         } else {
             return ++iterator(0, this);
         }
     }
     const_iterator begin() const {
-        if (status[0] == Status::OK) {
+        if (slot_count() == 0 || is_live(0)) {
             return const_iterator(0, this);
         } else {
             return ++const_iterator(0, this);
         }
     }
     iterator end() {
-        return iterator(data.size(), this);
+        return iterator(slot_count(), this);
     }
     const_iterator end() const {
-        return const_iterator(data.size(), this);
+        return const_iterator(slot_count(), this);
     }
 
     [[nodiscard]] size_t size() const {
         return sz;
     }
     [[nodiscard]] bool empty() const {
-        return data.empty();
+        return sz == 0;
     }
     const Hash& hash_function() const {
         return hasher;
     }
+    const KeyEqual& key_eq() const {
+        return key_equal;
+    }
 
-    void insert(const key_value_t& p) {
-        size_t index = get_index(data, status, p.first);
-        if (status[index] == Status::EMPTY) {
-            ++real_sz;
+    [[nodiscard]] size_t bucket_count() const {
+        return data.size();
+    }
+    [[nodiscard]] float load_factor() const {
+        if (bucket_count() == 0) {
+            return 0;
         }
-        if (status[index] != Status::OK) {
-            ++sz;
-            data[index] = p;
-            status[index] = Status::OK;
+        return static_cast<float>(sz) / static_cast<float>(bucket_count());
+    }
+    [[nodiscard]] float max_load_factor() const {
+        return max_lf;
+    }
+    // Takes effect from the next insertion, ml must be in (0, 1).
+    void max_load_factor(float ml) {
+        if (!(ml > 0 && ml < 1)) {
+            throw std::invalid_argument("");
         }
-        if (2 * real_sz > data.size()) {
-            rehash(2 * data.size());
+        max_lf = ml;
+    }
+
+    // Grows the table so that count entries fit without growing it again.
+    void reserve(size_t count) {
+        size_t new_size = data.size();
+        while (static_cast<float>(count) > max_lf * static_cast<float>(new_size)) {
+            new_size = std::max(2 * new_size, initial_size);
+        }
+        if (migrating()) {
+            migrate(old_data.size());
+        }
+        if (new_size != data.size()) {
+            rehash(new_size);
         }
     }
 
-    void erase(const KeyType& key) {
-        size_t index = get_index(data, status, key);
-        if (status[index] == Status::OK) {
-            --sz;
-            status[index] = Status::DELETED;
+    // Probe statistics walk the whole table. Entries still waiting in the old
+    // table of an incremental rehash are not part of the histogram.
+    [[nodiscard]] std::vector<size_t> probe_length_histogram() const {
+        std::vector<size_t> histogram;
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (is_full(ctrl[i])) {
+                size_t d = get_distance(i);
+                if (d >= histogram.size()) {
+                    histogram.resize(d + 1);
+                }
+                ++histogram[d];
+            }
         }
+        return histogram;
+    }
+    [[nodiscard]] size_t max_probe() const {
+        size_t result = 0;
+        for (size_t i = 0; i < data.size(); ++i) {
+            if (is_full(ctrl[i])) {
+                result = std::max(result, get_distance(i));
+            }
+        }
+        return result;
+    }
+    [[nodiscard]] size_t tombstone_count() const {
+        return std::count(old_ctrl.begin(), old_ctrl.begin() + old_data.size(), DELETED);
     }
 
-    iterator find(const KeyType& key) {
-        size_t index = get_index(data, status, key);
-        if (status[index] == Status::OK) {
-            return iterator(index, this);
+    std::pair<iterator, bool> insert(const key_value_t& p) {
+        return insert_impl(p);
+    }
+    std::pair<iterator, bool> insert(key_value_t&& p) {
+        return insert_impl(std::move(p));
+    }
+
+    // Unlike the other insertions the pair is built before probing, since
+    // the key is only known after construction.
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return insert_impl(key_value_t(std::forward<Args>(args)...));
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return try_emplace_impl(key, std::forward<Args>(args)...);
+    }
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return try_emplace_impl(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const KeyType& key, M&& obj) {
+        auto result = try_emplace_impl(key, std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(KeyType&& key, M&& obj) {
+        auto result = try_emplace_impl(std::move(key), std::forward<M>(obj));
+        if (!result.second) {
+            result.first->second = std::forward<M>(obj);
+        }
+        return result;
+    }
+
+    // key may refer to the erased entry, so migration runs after it is
+    // no longer used.
+    size_t erase(const KeyType& key) {
+        size_t index = find_index(key, get_hash(key));
+        if (index < data.size()) {
+            data[index]->~key_value_t();
+            close_hole(index);
+            --real_sz;
+        } else if (index != slot_count()) {
+            old_data[index - data.size()]->~key_value_t();
+            set_ctrl(old_ctrl, index - data.size(), DELETED);
+        } else {
+            migrate(MIGRATION_STEP);
+            return 0;
         }
-        return end();
+        --sz;
+        migrate(MIGRATION_STEP);
+        return 1;
     }
 
+    iterator find(const KeyType& key) {
+        return iterator(find_index(key, get_hash(key)), this);
+    }
     const_iterator find(const KeyType& key) const {
-        size_t index = get_index(data, status, key);
-        if (status[index] == Status::OK) {
-            return const_iterator(index, this);
+        return const_iterator(find_index(key, get_hash(key)), this);
+    }
+
+    template <class K, class = enable_if_transparent<K>>
+    iterator find(const K& key) {
+        return iterator(find_index(key, get_hash(key)), this);
+    }
+    template <class K, class = enable_if_transparent<K>>
+    const_iterator find(const K& key) const {
+        return const_iterator(find_index(key, get_hash(key)), this);
+    }
+
+    // out[i] becomes find(keys[i]); out must be at least as long as keys.
+    void find_batch(std::span<const KeyType> keys, std::span<const_iterator> out) const {
+        if (out.size() < keys.size()) {
+            throw std::invalid_argument("");
+        }
+        for_each_batch_index(keys, [&](size_t i, size_t index) {
+            out[i] = const_iterator(index, this);
+        });
+    }
+
+    void contains_batch(std::span<const KeyType> keys, std::span<bool> out) const {
+        if (out.size() < keys.size()) {
+            throw std::invalid_argument("");
         }
-        return end();
+        for_each_batch_index(keys, [&](size_t i, size_t index) {
+            out[i] = index != slot_count();
+        });
     }
 
     ValueType& operator[] (const KeyType& key) {
-        insert({key, ValueType()});
-        return find(key)->second;
+        return try_emplace_impl(key).first->second;
+    }
+    ValueType& operator[] (KeyType&& key) {
+        return try_emplace_impl(std::move(key)).first->second;
     }
 
     const ValueType& at(const KeyType& key) const {
-        size_t index = get_index(data, status, key);
-        if (status[index] == Status::OK) {
-            return data[index].second;
+        size_t index = find_index(key, get_hash(key));
+        if (index != slot_count()) {
+            return slot(index).second;
+        }
+        throw std::out_of_range("");
+    }
+
+    template <class K, class = enable_if_transparent<K>>
+    const ValueType& at(const K& key) const {
+        size_t index = find_index(key, get_hash(key));
+        if (index != slot_count()) {
+            return slot(index).second;
         }
         throw std::out_of_range("");
     }
 
     void clear() {
-        data.resize(initial_size);
-        status.assign(initial_size, Status::EMPTY);
+        destroy_all(data, ctrl);
+        destroy_all(old_data, old_ctrl);
+        data.clear();
+        ctrl.clear();
+        dist.clear();
+        probe_limit = 0;
+        std::vector<Slot>().swap(old_data);
+        std::vector<ctrl_t>().swap(old_ctrl);
+        migrated = 0;
         real_sz = 0;
         sz = 0;
     }
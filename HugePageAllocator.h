@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+
+#include "MyVector.h"
+
+
+// Allocator for very large vectors. Every allocation reserves at least
+// reserve_bytes of address space with mmap, aligned to huge pages and marked
+// MADV_HUGEPAGE, but only the part covering the requested elements is made
+// accessible. resize_in_place commits or releases pages inside the
+// reservation, so a Vector growing within it never moves its elements and
+// pointers into it stay valid. Physical memory is still only taken when a
+// page is first touched.
+template <typename T>
+class HugePageAllocator {
+public:
+    using value_type = T;
+
+    static constexpr size_t HUGE_PAGE = size_t(2) << 20;
+    static constexpr size_t DEFAULT_RESERVE = size_t(64) << 30;
+
+    explicit HugePageAllocator(size_t reserve_bytes = DEFAULT_RESERVE)
+            : reserve_bytes(reserve_bytes) {}
+
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>& other)
+            : reserve_bytes(other.reserve_bytes) {}
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T) - HUGE_PAGE) {
+            throw std::bad_alloc();
+        }
+        size_t reserved = reservation(n);
+        // over-reserve by one huge page and trim, for a huge page aligned start
+        void* mapped = mmap(nullptr, reserved + HUGE_PAGE, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (mapped == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        auto* start = static_cast<char*>(mapped);
+        auto* aligned = start + (HUGE_PAGE - reinterpret_cast<uintptr_t>(start) % HUGE_PAGE) % HUGE_PAGE;
+        if (aligned != start) {
+            munmap(start, aligned - start);
+        }
+        munmap(aligned + reserved, start + HUGE_PAGE - aligned);
+        madvise(aligned, reserved, MADV_HUGEPAGE);  // best effort, THP may be disabled
+
+        if (mprotect(aligned, committed(n), PROT_READ | PROT_WRITE) != 0) {
+            munmap(aligned, reserved);
+            throw std::bad_alloc();
+        }
+        return reinterpret_cast<T*>(aligned);
+    }
+
+    void deallocate(T* buf, size_t n) {
+        munmap(buf, reservation(n));
+    }
+
+    // Called by RawMemory before it falls back to allocating a new buffer.
+    bool resize_in_place(T* buf, size_t old_n, size_t n) {
+        // deallocate recomputes the reservation from the final capacity
+        if (n > SIZE_MAX / sizeof(T) - HUGE_PAGE || reservation(n) != reservation(old_n)) {
+            return false;
+        }
+        auto* bytes = reinterpret_cast<char*>(buf);
+        size_t old_committed = committed(old_n), new_committed = committed(n);
+        if (new_committed > old_committed) {
+            return mprotect(bytes + old_committed, new_committed - old_committed, PROT_READ | PROT_WRITE) == 0;
+        }
+        if (new_committed < old_committed) {
+            madvise(bytes + new_committed, old_committed - new_committed, MADV_DONTNEED);
+            mprotect(bytes + new_committed, old_committed - new_committed, PROT_NONE);
+        }
+        return true;
+    }
+
+    // Memory can be returned through any allocator computing the same
+    // reservation sizes.
+    template <typename U>
+    bool operator==(const HugePageAllocator<U>& other) const {
+        return reserve_bytes == other.reserve_bytes;
+    }
+    template <typename U>
+    bool operator!=(const HugePageAllocator<U>& other) const {
+        return !(*this == other);
+    }
+
+private:
+    template <typename U>
+    friend class HugePageAllocator;
+
+    size_t reserve_bytes;
+
+    static size_t round_up(size_t bytes) {
+        return (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+    }
+
+    // Depends only on n, so deallocate and resize_in_place can recompute it.
+    // It does not change when the capacity grows within the reservation.
+    size_t reservation(size_t n) const {
+        return round_up(std::max(n * sizeof(T), reserve_bytes));
+    }
+
+    static size_t committed(size_t n) {
+        return round_up(n * sizeof(T));
+    }
+};
+
+template <typename T>
+using HugePageVector = Vector<T, RawMemory<T, HugePageAllocator<T>>>;
@@ -1,106 +1,298 @@
+#pragma once
+
 #include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include "ObjectPool.h"
 
 // it is cyclic: ++List.end() == List.begin()
+template <typename T>
 class List {
-public:
-    struct Node {
-        Node * prev = this, * next = this;
-        int * item;
-
-        Node(): item(nullptr) {}
+private:
+    // the part of a node the sentinel has too, it holds no value
+    struct Link {
+        Link * prev = this, * next = this;
+    };
 
-        explicit Node(int item): item(new int(item)) {}
+    struct Node : Link {
+        T item;
 
-        ~Node() {
-            delete this->item;
-        }
+        template <typename... Args>
+        explicit Node(Args&&... args): item(std::forward<Args>(args)...) {}
     };
 
-    class iterator {
+    // nodes are recycled, a queue at a steady size does not call malloc
+    using Pool = ObjectPool<Node>;
+
+    template <bool Const>
+    class basic_iterator {
     private:
-        Node * ptr;
+        Link * ptr;
+
+        friend class List;
 
     public:
-        explicit iterator(Node * other_ptr = nullptr): ptr(other_ptr) {}
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const T *, T *>;
+        using reference = std::conditional_t<Const, const T&, T&>;
+
+        explicit basic_iterator(Link * other_ptr = nullptr): ptr(other_ptr) {}
+
+        // iterator converts to const_iterator
+        template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        basic_iterator(const basic_iterator<OtherConst>& other): ptr(other.ptr) {}
 
-        bool inline operator == (const iterator& other) const {
-            return this->ptr->item == other.ptr->item;
+        bool inline operator == (const basic_iterator& other) const {
+            return this->ptr == other.ptr;
         }
 
-        bool inline operator != (const iterator& other) const {
+        bool inline operator != (const basic_iterator& other) const {
             return !(*this == other);
         }
 
-        int inline operator * () const {
-            return *(this->ptr->item);
+        reference inline operator * () const {
+            return static_cast<Node *>(this->ptr)->item;
         }
 
-        iterator& operator++ () {
+        pointer inline operator -> () const {
+            return &static_cast<Node *>(this->ptr)->item;
+        }
+
+        basic_iterator& operator++ () {
             this->ptr = this->ptr->next;
             return *this;
         }
 
-        iterator& operator-- () {
+        basic_iterator operator++ (int) {
+            basic_iterator copy = *this;
+            this->ptr = this->ptr->next;
+            return copy;
+        }
+
+        basic_iterator& operator-- () {
             this->ptr = this->ptr->prev;
             return *this;
         }
+
+        basic_iterator operator-- (int) {
+            basic_iterator copy = *this;
+            this->ptr = this->ptr->prev;
+            return copy;
+        }
     };
 
+public:
+    using value_type = T;
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
 private:
     size_t actual_size;
-    Node * after_last;
+    Link after_last;
+
+    // links node in front of pos
+    static inline void link_before(Link * pos, Link * node) {
+        node->prev = pos->prev;
+        node->next = pos;
+        pos->prev->next = node;
+        pos->prev = node;
+    }
+
+    static inline void unlink(Link * node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+    }
+
+    // moves [first, last] in front of pos, pos must not be inside it
+    static inline void relink_before(Link * pos, Link * first, Link * last) {
+        first->prev->next = last->next;
+        last->next->prev = first->prev;
+        first->prev = pos->prev;
+        last->next = pos;
+        pos->prev->next = first;
+        pos->prev = last;
+    }
+
+    static inline void destroy_node(Link * link) {
+        Pool::destroy(static_cast<Node *>(link));
+    }
+
+    // Takes over the nodes of other, which must be empty afterwards.
+    inline void steal(List& other) {
+        if (other.actual_size == 0) return;
+        relink_before(&after_last, other.after_last.next, other.after_last.prev);
+        actual_size = other.actual_size;
+        other.actual_size = 0;
+    }
 
 public:
-    List(): actual_size(0), after_last(new Node()) {}
+    List(): actual_size(0) {}
+
+    List(const List& other): List() {
+        try {
+            for (const T& item : other) emplace_back(item);
+        } catch (...) {
+            clear();
+            throw;
+        }
+    }
+
+    // after_last lives inside the list, so the nodes are relinked to it
+    List(List&& other) noexcept: List() {
+        steal(other);
+    }
+
+    List& operator = (const List& other) {
+        if (this != &other) {
+            List copy(other);
+            clear();
+            steal(copy);
+        }
+        return *this;
+    }
+
+    List& operator = (List&& other) noexcept {
+        if (this != &other) {
+            clear();
+            steal(other);
+        }
+        return *this;
+    }
 
     ~List() {
-        while (actual_size) pop_front();
-        delete after_last;
+        clear();
     }
 
-    [[nodiscard]] inline iterator begin() const {
-        return iterator(after_last->next);
+    [[nodiscard]] inline iterator begin() {
+        return iterator(after_last.next);
     }
 
-    [[nodiscard]] inline iterator end() const {
-        return iterator(after_last);
+    [[nodiscard]] inline iterator end() {
+        return iterator(&after_last);
+    }
+
+    [[nodiscard]] inline const_iterator begin() const {
+        return const_iterator(after_last.next);
+    }
+
+    [[nodiscard]] inline const_iterator end() const {
+        return const_iterator(const_cast<Link *>(&after_last));
     }
 
     [[nodiscard]] inline size_t size() const {
         return actual_size;
     }
 
-    inline void push_back(int elem) {
+    [[nodiscard]] inline bool empty() const {
+        return actual_size == 0;
+    }
+
+    inline T& front() {
+        return static_cast<Node *>(after_last.next)->item;
+    }
+
+    inline const T& front() const {
+        return static_cast<const Node *>(after_last.next)->item;
+    }
+
+    inline T& back() {
+        return static_cast<Node *>(after_last.prev)->item;
+    }
+
+    inline const T& back() const {
+        return static_cast<const Node *>(after_last.prev)->item;
+    }
+
+    // Constructs the element in place in front of pos.
+    template <typename... Args>
+    inline iterator emplace(const_iterator pos, Args&&... args) {
+        Node * to_add = Pool::create(std::forward<Args>(args)...);
+        link_before(pos.ptr, to_add);
         ++actual_size;
-        Node * to_add = new Node(elem), * real_last = after_last->prev;
-        to_add->prev = real_last;
-        to_add->next = after_last;
-        real_last->next = to_add;
-        after_last->prev = to_add;
+        return iterator(to_add);
     }
 
-    inline void pop_back() {
+    inline iterator insert(const_iterator pos, const T& elem) {
+        return emplace(pos, elem);
+    }
+
+    inline iterator insert(const_iterator pos, T&& elem) {
+        return emplace(pos, std::move(elem));
+    }
+
+    // Returns the iterator following the erased element.
+    inline iterator erase(const_iterator pos) {
+        Link * next = pos.ptr->next;
+        unlink(pos.ptr);
+        destroy_node(pos.ptr);
         --actual_size;
-        Node * real_last = after_last->prev;
-        after_last->prev = real_last->prev;
-        after_last->prev->next = after_last;
-        delete real_last;
+        return iterator(next);
     }
 
-    inline void push_front(int elem) {
-        ++actual_size;
-        Node * to_add = new Node(elem), * real_first = after_last->next;
-        to_add->next = real_first;
-        to_add->prev = after_last;
-        after_last->next = to_add;
-        real_first->prev = to_add;
+    template <typename... Args>
+    inline T& emplace_back(Args&&... args) {
+        return *emplace(end(), std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    inline T& emplace_front(Args&&... args) {
+        return *emplace(begin(), std::forward<Args>(args)...);
+    }
+
+    inline void push_back(const T& elem) {
+        emplace_back(elem);
+    }
+
+    inline void push_back(T&& elem) {
+        emplace_back(std::move(elem));
+    }
+
+    inline void pop_back() {
+        erase(const_iterator(after_last.prev));
+    }
+
+    inline void push_front(const T& elem) {
+        emplace_front(elem);
+    }
+
+    inline void push_front(T&& elem) {
+        emplace_front(std::move(elem));
     }
 
     inline void pop_front() {
-        --actual_size;
-        Node * real_first = after_last->next;
-        after_last->next = real_first->next;
-        after_last->next->prev = after_last;
-        delete real_first;
+        erase(const_iterator(after_last.next));
+    }
+
+    // Moves all elements of other in front of pos, no element is copied and
+    // iterators to them stay valid. other must be a different list.
+    inline void splice(const_iterator pos, List& other) {
+        if (other.actual_size == 0) return;
+        relink_before(pos.ptr, other.after_last.next, other.after_last.prev);
+        actual_size += other.actual_size;
+        other.actual_size = 0;
+    }
+
+    // Moves the element at it from other in front of pos. other may be this
+    // list, e.g. to move a cache entry to the front.
+    inline void splice(const_iterator pos, List& other, const_iterator it) {
+        if (pos == it || pos.ptr == it.ptr->next) return;
+        relink_before(pos.ptr, it.ptr, it.ptr);
+        --other.actual_size;
+        ++actual_size;
+    }
+
+    inline void clear() {
+        Link * link = after_last.next;
+        while (link != &after_last) {
+            Link * next = link->next;
+            destroy_node(link);
+            link = next;
+        }
+        after_last.prev = after_last.next = &after_last;
+        actual_size = 0;
     }
 };
@@ -1,38 +1,163 @@
+#pragma once
+
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
 #include <memory>
+#include <memory_resource>
 #include <new>
+#include <ratio>
+#include <type_traits>
 #include <utility>
 
+// Types whose objects can be moved to another address with memcpy, the old
+// copy being forgotten without its destructor running. Vector relocates such
+// elements bytewise and grows their buffers with the allocator's reallocate
+// when it has one. Specialize it for types that qualify without being
+// trivially copyable.
+template <typename T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T> {};
+
+// Default allocator of RawMemory. Besides the standard interface it has
+// reallocate, which RawMemory uses to grow trivially relocatable elements in
+// place: large blocks are remapped by the C library instead of copied.
 template <typename T>
+struct MallocAllocator {
+    using value_type = T;
+
+    MallocAllocator() = default;
+    template <typename U>
+    MallocAllocator(const MallocAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        T* buf = static_cast<T*>(std::malloc(n * sizeof(T)));
+        if (!buf) {
+            throw std::bad_alloc();
+        }
+        return buf;
+    }
+
+    void deallocate(T* buf, size_t) {
+        std::free(buf);
+    }
+
+    // Only for trivially relocatable T. On failure buf is left untouched.
+    T* reallocate(T* buf, size_t, size_t n) {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        T* grown = static_cast<T*>(std::realloc(static_cast<void*>(buf), n * sizeof(T)));
+        if (!grown) {
+            throw std::bad_alloc();
+        }
+        return grown;
+    }
+
+    template <typename U>
+    bool operator==(const MallocAllocator<U>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const MallocAllocator<U>&) const {
+        return false;
+    }
+};
+
+// Allocator is any standard allocator, std::pmr::polymorphic_allocator
+// included. As with the standard containers, memories whose allocators do not
+// propagate on swap may only be swapped if the allocators compare equal.
+template <typename T, typename Allocator = MallocAllocator<T>>
 struct RawMemory {
+    using allocator_type = Allocator;
+    using Traits = std::allocator_traits<Allocator>;
+
+    // Elements a memory can keep inside itself, see SmallRawMemory.
+    static constexpr size_t inline_cp = 0;
+
     T* buf = nullptr;
     size_t cp = 0;
+    [[no_unique_address]] Allocator alloc;
 
-    static T* Allocate(size_t n) {
-        return static_cast<T*>(operator new(n * sizeof(T)));
+    T* Allocate(size_t n) {
+        return n == 0 ? nullptr : Traits::allocate(alloc, n);
     }
 
-    static void Deallocate(T* buf) {
-        operator delete(buf);
+    void Deallocate(T* buf, size_t n) {
+        if (buf) {
+            Traits::deallocate(alloc, buf, n);
+        }
     }
 
     void Swap(RawMemory& other) noexcept {
         std::swap(buf, other.buf);
         std::swap(cp, other.cp);
+        if constexpr (Traits::propagate_on_container_swap::value) {
+            std::swap(alloc, other.alloc);
+        }
+    }
+
+    [[nodiscard]] bool IsInline() const {
+        return false;
+    }
+
+    Allocator get_allocator() const {
+        return alloc;
+    }
+
+    // Changes the capacity to n without moving the elements, if the
+    // allocator has resize_in_place and can do it.
+    bool TryResizeInPlace(size_t n) {
+        if constexpr (requires { alloc.resize_in_place(buf, cp, n); }) {
+            if (buf && n != 0 && alloc.resize_in_place(buf, cp, n)) {
+                cp = n;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Changes the capacity to n keeping the first live elements, which must
+    // be trivially relocatable. Callers have tried TryResizeInPlace first.
+    void Resize(size_t n, size_t live) {
+        if (n == 0) {
+            Deallocate(buf, cp);
+            buf = nullptr;
+        } else if constexpr (requires { alloc.reallocate(buf, cp, n); }) {
+            buf = alloc.reallocate(buf, cp, n);
+        } else {
+            T* resized = Allocate(n);
+            if (live != 0) {
+                std::memcpy(static_cast<void*>(resized), static_cast<const void*>(buf), live * sizeof(T));
+            }
+            Deallocate(buf, cp);
+            buf = resized;
+        }
+        cp = n;
     }
 
     RawMemory() = default;
 
-    explicit RawMemory(size_t n) {
+    explicit RawMemory(const Allocator& alloc)
+            : alloc(alloc) {}
+
+    explicit RawMemory(size_t n, const Allocator& alloc = Allocator())
+            : alloc(alloc) {
         buf = Allocate(n);
         cp = n;
     }
 
     RawMemory(const RawMemory&) = delete;
 
-    RawMemory(RawMemory&& other) noexcept {
-        Swap(other);
-    }
+    RawMemory(RawMemory&& other) noexcept
+            : buf(std::exchange(other.buf, nullptr))
+            , cp(std::exchange(other.cp, 0))
+            , alloc(other.alloc) {}
 
     RawMemory& operator=(const RawMemory&) = delete;
 
@@ -56,35 +181,124 @@ struct RawMemory {
     }
 
     ~RawMemory() {
-        Deallocate(buf);
+        Deallocate(buf, cp);
     }
 };
 
-template <typename T>
+// Growth is the factor capacity is multiplied by when the vector is full.
+// A vector keeps the allocator of its memory: copy and move assignment do not
+// replace it, swap exchanges it only if it propagates on swap.
+template <typename T, typename Memory = RawMemory<T>, typename Growth = std::ratio<2>>
 class Vector {
 private:
-    RawMemory<T> data;
+    static_assert(Growth::num > Growth::den, "the growth factor must be greater than one");
+
+    static constexpr bool relocatable = IsTriviallyRelocatable<T>::value;
+
+    Memory data;
     size_t sz = 0;
 
+    size_t NewCapacity(size_t needed) const {
+        return std::max(needed, static_cast<size_t>(capacity() * Growth::num / Growth::den));
+    }
+
+    static void MoveBytes(T* to, const T* from, size_t n) {
+        if (n != 0) {
+            std::memmove(static_cast<void*>(to), static_cast<const void*>(from), n * sizeof(T));
+        }
+    }
+
+    // Moves only if that cannot throw, so a failed copy leaves the source
+    // intact. On failure the elements constructed in to are destroyed.
+    static void MoveOrCopy(T* from, size_t n, T* to) {
+        if constexpr (std::is_nothrow_move_constructible_v<T> || !std::is_copy_constructible_v<T>) {
+            std::uninitialized_move_n(from, n, to);
+        } else {
+            std::uninitialized_copy_n(from, n, to);
+        }
+    }
+
+    // Transfers the elements to the fresh memory to, leaving gap_size slots
+    // free at index gap, and makes it the vector's memory. If it throws the
+    // vector is unchanged.
+    void RelocateTo(Memory& to, size_t gap, size_t gap_size) {
+        if constexpr (relocatable) {
+            MoveBytes(to + 0, data + 0, gap);
+            MoveBytes(to + gap + gap_size, data + gap, sz - gap);
+        } else {
+            MoveOrCopy(data + 0, gap, to + 0);
+            try {
+                MoveOrCopy(data + gap, sz - gap, to + gap + gap_size);
+            } catch (...) {
+                std::destroy_n(to + 0, gap);
+                throw;
+            }
+            std::destroy_n(data + 0, sz);
+        }
+        data.Swap(to);
+    }
+
+    // Elements kept inside the memory object cannot change owners by
+    // swapping pointers, they are moved one by one.
+    void SwapInline(Vector& other) noexcept {
+        Vector& small = data.IsInline() ? *this : other;
+        Vector& big = &small == this ? other : *this;
+        if (!big.data.IsInline()) {
+            // the heap vector's own inline storage is free, it receives
+            // the elements and is handed over together with them
+            std::uninitialized_move_n(small.data.buf, small.sz, big.data.Inline());
+            std::destroy_n(small.data.buf, small.sz);
+            data.Swap(other.data);
+        } else {
+            size_t common = std::min(sz, other.sz);
+            for (size_t i = 0; i < common; ++i) {
+                std::swap(data[i], other.data[i]);
+            }
+            Vector& longer = sz > other.sz ? *this : other;
+            Vector& shorter = &longer == this ? other : *this;
+            std::uninitialized_move_n(longer.data + common, longer.sz - common, shorter.data + common);
+            std::destroy_n(longer.data + common, longer.sz - common);
+        }
+        std::swap(sz, other.sz);
+    }
+
 public:
+    using allocator_type = typename Memory::allocator_type;
+
     Vector() = default;
 
-    explicit Vector(size_t n): data(n) {
+    explicit Vector(const allocator_type& alloc): data(alloc) {}
+
+    explicit Vector(size_t n, const allocator_type& alloc = allocator_type()): data(n, alloc) {
         std::uninitialized_value_construct_n(data.buf, n);
         sz = n;
     }
 
-    Vector(const Vector& other): data(other.sz) {
+    Vector(const Vector& other)
+            : Vector(other, std::allocator_traits<allocator_type>::select_on_container_copy_construction(
+                    other.get_allocator())) {}
+
+    Vector(const Vector& other, const allocator_type& alloc): data(other.sz, alloc) {
         std::uninitialized_copy_n(other.data.buf, other.sz, data.buf);
         sz = other.sz;
     }
 
+    allocator_type get_allocator() const {
+        return data.get_allocator();
+    }
+
     void swap(Vector& other) noexcept {
+        if constexpr (Memory::inline_cp != 0) {
+            if (data.IsInline() || other.data.IsInline()) {
+                SwapInline(other);
+                return;
+            }
+        }
         data.Swap(other.data);
         std::swap(sz, other.sz);
     }
 
-    Vector(Vector&& other) noexcept {
+    Vector(Vector&& other) noexcept: data(other.get_allocator()) {
         swap(other);
     }
 
@@ -93,11 +307,31 @@ public:
     }
 
     void reserve(size_t n) {
-        if (n > capacity()) {
-            RawMemory<T> data2(n);
-            std::uninitialized_move_n(data.buf, sz, data2.buf);
-            std::destroy_n(data.buf, sz);
-            data.Swap(data2);
+        if (n <= capacity() || data.TryResizeInPlace(n)) {
+            return;
+        }
+        if constexpr (relocatable) {
+            data.Resize(n, sz);
+        } else {
+            Memory data2(n, data.get_allocator());
+            RelocateTo(data2, sz, 0);
+        }
+    }
+
+    void shrink_to_fit() {
+        if (sz == capacity() || data.IsInline() || data.TryResizeInPlace(sz)) {
+            return;
+        }
+        if constexpr (relocatable) {
+            data.Resize(sz, sz);
+        } else {
+            // an inline memory can only be filled in place, so go through
+            // a vector of exactly the right size and swap with it
+            Vector tmp(get_allocator());
+            tmp.reserve(sz);
+            MoveOrCopy(data + 0, sz, tmp.data + 0);
+            tmp.sz = sz;
+            swap(tmp);
         }
     }
 
@@ -119,7 +353,7 @@ public:
 
     Vector& operator=(const Vector& other) {
         if (other.sz > capacity()) {
-            Vector tmp(other);
+            Vector tmp(other, get_allocator());
             swap(tmp);
         } else {
             for (size_t i = 0; i < sz && i < other.sz; ++i) {
@@ -134,7 +368,19 @@ public:
         }
         return *this;
     }
-    Vector& operator=(Vector&& other) noexcept {
+    Vector& operator=(Vector&& other) noexcept(std::allocator_traits<allocator_type>::is_always_equal::value) {
+        if constexpr (!std::allocator_traits<allocator_type>::is_always_equal::value) {
+            if (get_allocator() != other.get_allocator()) {
+                // the buffer cannot change hands, move the elements over
+                Vector tmp(get_allocator());
+                tmp.reserve(other.sz);
+                std::uninitialized_move_n(other.data + 0, other.sz, tmp.data + 0);
+                tmp.sz = other.sz;
+                swap(tmp);
+                other.clear();
+                return *this;
+            }
+        }
         swap(other);
         return *this;
     }
@@ -152,19 +398,92 @@ public:
     void clear() {
         resize(0);
     }
-    void push_back(const T& elem) {
-        if (sz == capacity()) {
-            reserve(sz == 0 ? 1 : sz * 2);
+    // args may refer to an element of the vector itself.
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (sz == capacity() && !data.TryResizeInPlace(NewCapacity(sz + 1))) {
+            if constexpr (relocatable) {
+                T elem(std::forward<Args>(args)...);
+                data.Resize(NewCapacity(sz + 1), sz);
+                new (data + sz) T(std::move(elem));
+            } else {
+                Memory data2(NewCapacity(sz + 1), data.get_allocator());
+                new (data2 + sz) T(std::forward<Args>(args)...);
+                try {
+                    RelocateTo(data2, sz, 1);
+                } catch (...) {
+                    std::destroy_at(data2 + sz);
+                    throw;
+                }
+            }
+        } else {
+            new (data + sz) T(std::forward<Args>(args)...);
         }
-        new (data + sz) T(elem);
-        ++sz;
+        return data[sz++];
+    }
+    void push_back(const T& elem) {
+        emplace_back(elem);
     }
     void push_back(T&& elem) {
-        if (sz == capacity()) {
-            reserve(sz == 0 ? 1 : sz * 2);
+        emplace_back(std::move(elem));
+    }
+
+    // Inserts [first, last) before pos; the range may come from the vector
+    // itself. Returns a pointer to the first inserted element.
+    template <typename Iter>
+    T* insert(const T* pos, Iter first, Iter last) {
+        size_t index = pos - data.buf;
+        using Category = typename std::iterator_traits<Iter>::iterator_category;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+            size_t n = std::distance(first, last);
+            if (sz + n > capacity() && !data.TryResizeInPlace(NewCapacity(sz + n))) {
+                Memory data2(NewCapacity(sz + n), data.get_allocator());
+                std::uninitialized_copy(first, last, data2 + index);
+                try {
+                    RelocateTo(data2, index, n);
+                } catch (...) {
+                    std::destroy_n(data2 + index, n);
+                    throw;
+                }
+                sz += n;
+                return data + index;
+            }
+        }
+        // append, then rotate the new elements into place
+        size_t old_sz = sz;
+        try {
+            for (; first != last; ++first) {
+                emplace_back(*first);
+            }
+        } catch (...) {
+            std::destroy_n(data + old_sz, sz - old_sz);
+            sz = old_sz;
+            throw;
+        }
+        std::rotate(data + index, data + old_sz, data + sz);
+        return data + index;
+    }
+    T* insert(const T* pos, const T& elem) {
+        return insert(pos, &elem, &elem + 1);
+    }
+
+    // Returns a pointer to the element that followed the erased ones.
+    T* erase(const T* first, const T* last) {
+        size_t from = first - data.buf, to = last - data.buf;
+        if (from != to) {
+            if constexpr (relocatable) {
+                std::destroy(data + from, data + to);
+                MoveBytes(data + from, data + to, sz - to);
+            } else {
+                std::move(data + to, data + sz, data + from);
+                std::destroy(data + (sz - (to - from)), data + sz);
+            }
+            sz -= to - from;
         }
-        new (data + sz) T(std::move(elem));
-        ++sz;
+        return data + from;
+    }
+    T* erase(const T* pos) {
+        return erase(pos, pos + 1);
     }
     void pop_back() {
         std::destroy_at(data + sz - 1);
@@ -185,3 +504,7 @@ public:
     }
 };
 
+// Vector over a std::pmr::memory_resource. Over an ArenaResource, ArenaVector
+// can also grow in place.
+template <typename T>
+using PmrVector = Vector<T, RawMemory<T, std::pmr::polymorphic_allocator<T>>>;
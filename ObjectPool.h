@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// Recycles the memory of objects of one type through a per-thread free
+// list, so code that keeps creating and destroying them (list nodes,
+// request objects) stops going to malloc once it has reached its working
+// size. Objects are still allocated one by one, so any thread may free an
+// object another thread allocated; it then joins the freeing thread's list.
+// Objects may outlive their thread's list, e.g. pooled objects held by
+// statics of the main thread, whose thread_locals are destroyed first:
+// they then go back to operator delete.
+template <typename T>
+class ObjectPool {
+private:
+    struct FreeCell {
+        FreeCell * next;
+    };
+
+    static const size_t SIZE = std::max(sizeof(T), sizeof(FreeCell));
+    static const size_t ALIGNMENT = std::max(alignof(T), alignof(FreeCell));
+    static const size_t MAX_POOLED = 4096;
+
+    struct FreeList {
+        FreeCell * head = nullptr;
+        size_t count = 0;
+
+        ~FreeList() {
+            list_destroyed = true;
+            while (head) {
+                FreeCell * next = head->next;
+                ::operator delete(head, std::align_val_t(ALIGNMENT));
+                head = next;
+            }
+        }
+    };
+
+    // Trivially destructible, so it can still be read after the list died.
+    static inline thread_local bool list_destroyed = false;
+
+    static inline FreeList& free_list() {
+        thread_local FreeList list;
+        return list;
+    }
+
+public:
+    // Memory for one T.
+    static inline void * allocate() {
+        if (list_destroyed) {
+            return ::operator new(SIZE, std::align_val_t(ALIGNMENT));
+        }
+        FreeList& list = free_list();
+        if (list.head) {
+            FreeCell * cell = list.head;
+            list.head = cell->next;
+            --list.count;
+            return cell;
+        }
+        return ::operator new(SIZE, std::align_val_t(ALIGNMENT));
+    }
+
+    static inline void deallocate(void * ptr) noexcept {
+        if (list_destroyed) {
+            ::operator delete(ptr, std::align_val_t(ALIGNMENT));
+            return;
+        }
+        FreeList& list = free_list();
+        if (list.count == MAX_POOLED) {
+            ::operator delete(ptr, std::align_val_t(ALIGNMENT));
+            return;
+        }
+        list.head = new (ptr) FreeCell{list.head};
+        ++list.count;
+    }
+
+    template <typename... Args>
+    static T * create(Args&&... args) {
+        void * memory = allocate();
+        try {
+            return new (memory) T(std::forward<Args>(args)...);
+        } catch (...) {
+            deallocate(memory);
+            throw;
+        }
+    }
+
+    static void destroy(T * ptr) noexcept {
+        ptr->~T();
+        deallocate(ptr);
+    }
+};
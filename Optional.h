@@ -1,110 +1,273 @@
+#pragma once
+
+#include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <type_traits>
+#include <utility>
 
 struct BadOptionalAccess: public std::exception {
 };
 
+// Niche hook. A specialization with has_niche = true names a value of T
+// that is never used as a real value, e.g. an id sentinel. Optional<T>
+// then stores that value when empty and is exactly as large as T.
+//
+//     static constexpr bool has_niche = true;
+//     static constexpr T empty_value() noexcept;
+//     static constexpr bool is_empty(const T& val) noexcept;
 template <typename T>
-class Optional {
-private:
-    alignas(T) unsigned char bytes[sizeof(T)]{};
-    bool defined = false;
+struct OptionalTraits {
+    static constexpr bool has_niche = false;
+};
 
-public:
-    Optional() = default;
+// For types with a reserved value, e.g.
+//     template <> struct OptionalTraits<NodeId>: SentinelOptionalTraits<NodeId, NodeId{UINT32_MAX}> {};
+template <typename T, T Sentinel>
+struct SentinelOptionalTraits {
+    static constexpr bool has_niche = true;
 
-    explicit Optional(const T& val) {
-        new (bytes) T(val);
-        defined = true;
+    static constexpr T empty_value() noexcept {
+        return Sentinel;
+    }
+
+    static constexpr bool is_empty(const T& val) noexcept {
+        return val == Sentinel;
+    }
+};
+
+// For doubles that never hold this NaN payload, which arithmetic does not
+// produce, opt in with
+//     template <> struct OptionalTraits<double>: NanBoxOptionalTraits {};
+struct NanBoxOptionalTraits {
+    static constexpr bool has_niche = true;
+    static constexpr uint64_t EMPTY_BITS = 0x7FF4'0000'DEAD'BEEF;
+
+    static constexpr double empty_value() noexcept {
+        return std::bit_cast<double>(EMPTY_BITS);
+    }
+
+    static constexpr bool is_empty(const double& val) noexcept {
+        return std::bit_cast<uint64_t>(val) == EMPTY_BITS;
+    }
+};
+
+// For pointers to a type aligned to 2 or more, which are never odd, so
+// address 1 is free. Opt in per pointee type, where it is complete, e.g.
+//     template <> struct OptionalTraits<Node *>: PointerOptionalTraits<Node> {};
+// Such an Optional can't be created in a constant expression.
+template <typename T>
+struct PointerOptionalTraits {
+    static_assert(alignof(T) > 1, "address 1 may point to a T");
+
+    static constexpr bool has_niche = true;
+
+    static T * empty_value() noexcept {
+        return reinterpret_cast<T *>(1);
     }
-    explicit Optional(T && val) {
-        new (bytes) T(std::move(val));
+
+    static bool is_empty(T * const& val) noexcept {
+        return val == empty_value();
+    }
+};
+
+// Value and empty state of Optional. Each special member is trivial when
+// T's is, so Optional<T> of a trivially copyable T is trivially copyable.
+template <typename T, bool Niche = OptionalTraits<T>::has_niche>
+class OptionalStorage {
+protected:
+    union {
+        char empty;
+        T val;
+    };
+    bool defined = false;
+
+    [[nodiscard]] constexpr bool is_defined() const noexcept {
+        return defined;
+    }
+
+    template <typename... Args>
+    constexpr void construct(Args&&... args) {
+        std::construct_at(std::addressof(val), std::forward<Args>(args)...);
         defined = true;
     }
-    Optional(const Optional& opt) {
-        if (opt.defined) {
-            defined = true;
-            new (bytes) T(*reinterpret_cast<const T *>(opt.bytes));
+
+    constexpr void destroy() noexcept {
+        if (defined) {
+            std::destroy_at(std::addressof(val));
+            defined = false;
         }
     }
 
-    Optional& operator= (const Optional& opt) {
-        if (this == &opt) {
-            return *this;
-        }
-        if (defined) {
-            if (opt.defined) {
-                *(reinterpret_cast<T *>(bytes)) = *(reinterpret_cast<const T *>(opt.bytes));
+    template <typename Other>
+    constexpr void assign(Other&& other) {
+        if (other.defined) {
+            if (defined) {
+                val = std::forward<Other>(other).val;
             } else {
-                reinterpret_cast<T*>(bytes)->~T();
-                defined = false;
+                construct(std::forward<Other>(other).val);
             }
-        } else if (opt.defined) {
-            new (bytes) T(*reinterpret_cast<const T*>(opt.bytes));
-            defined = true;
+        } else {
+            destroy();
         }
+    }
+
+public:
+    constexpr OptionalStorage() noexcept: empty() {}
+
+    constexpr OptionalStorage(const OptionalStorage&)
+        requires std::is_trivially_copy_constructible_v<T> = default;
+    constexpr OptionalStorage(const OptionalStorage& other)
+        requires (std::is_copy_constructible_v<T> && !std::is_trivially_copy_constructible_v<T>)
+            : empty() {
+        if (other.defined) construct(other.val);
+    }
+
+    constexpr OptionalStorage(OptionalStorage&&)
+        requires std::is_trivially_move_constructible_v<T> = default;
+    constexpr OptionalStorage(OptionalStorage&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+        requires (std::is_move_constructible_v<T> && !std::is_trivially_move_constructible_v<T>)
+            : empty() {
+        if (other.defined) construct(std::move(other.val));
+    }
+
+    constexpr OptionalStorage& operator= (const OptionalStorage&)
+        requires (std::is_trivially_copy_assignable_v<T> && std::is_trivially_copy_constructible_v<T> &&
+                  std::is_trivially_destructible_v<T>) = default;
+    constexpr OptionalStorage& operator= (const OptionalStorage& other)
+        requires (std::is_copy_assignable_v<T> && std::is_copy_constructible_v<T> &&
+                  !(std::is_trivially_copy_assignable_v<T> && std::is_trivially_copy_constructible_v<T> &&
+                    std::is_trivially_destructible_v<T>)) {
+        if (this != &other) assign(other);
         return *this;
     }
-    Optional& operator= (const T& elem) {
-        if (defined) {
-            *(reinterpret_cast<T *>(bytes)) = elem;
+
+    constexpr OptionalStorage& operator= (OptionalStorage&&)
+        requires (std::is_trivially_move_assignable_v<T> && std::is_trivially_move_constructible_v<T> &&
+                  std::is_trivially_destructible_v<T>) = default;
+    constexpr OptionalStorage& operator= (OptionalStorage&& other)
+            noexcept(std::is_nothrow_move_assignable_v<T> && std::is_nothrow_move_constructible_v<T>)
+        requires (std::is_move_assignable_v<T> && std::is_move_constructible_v<T> &&
+                  !(std::is_trivially_move_assignable_v<T> && std::is_trivially_move_constructible_v<T> &&
+                    std::is_trivially_destructible_v<T>)) {
+        if (this != &other) assign(std::move(other));
+        return *this;
+    }
+
+    constexpr ~OptionalStorage() requires std::is_trivially_destructible_v<T> = default;
+    constexpr ~OptionalStorage() {
+        destroy();
+    }
+};
+
+// With a niche the slot always holds a T, empty_value() when empty.
+template <typename T>
+class OptionalStorage<T, true> {
+protected:
+    using Traits = OptionalTraits<T>;
+
+    T val = Traits::empty_value();
+
+    [[nodiscard]] constexpr bool is_defined() const noexcept {
+        return !Traits::is_empty(val);
+    }
+
+    template <typename... Args>
+    constexpr void construct(Args&&... args) {
+        val = T(std::forward<Args>(args)...);
+    }
+
+    constexpr void destroy() noexcept {
+        val = Traits::empty_value();
+    }
+};
+
+template <typename T>
+class Optional: public OptionalStorage<T> {
+private:
+    using Storage = OptionalStorage<T>;
+    using Storage::val;
+    using Storage::construct;
+    using Storage::destroy;
+    using Storage::is_defined;
+
+public:
+    constexpr Optional() = default;
+
+    constexpr explicit Optional(const T& val) {
+        construct(val);
+    }
+    constexpr explicit Optional(T && val) {
+        construct(std::move(val));
+    }
+    template <typename... Args>
+    constexpr explicit Optional(std::in_place_t, Args&&... args) {
+        construct(std::forward<Args>(args)...);
+    }
+
+    constexpr Optional& operator= (const T& elem) {
+        if (is_defined()) {
+            val = elem;
         } else {
-            new (bytes) T(elem);
-            defined = true;
+            construct(elem);
         }
         return *this;
     }
-    Optional& operator= (T&& elem) {
-        if (defined) {
-            *(reinterpret_cast<T *>(bytes)) = std::move(elem);
+    constexpr Optional& operator= (T&& elem) {
+        if (is_defined()) {
+            val = std::move(elem);
         } else {
-            new (bytes) T(std::move(elem));
-            defined = true;
+            construct(std::move(elem));
         }
         return *this;
     }
 
-    [[nodiscard]] bool has_value() const {
-        return defined;
+    // Destroys the current value, if any, and constructs a new one in place.
+    template <typename... Args>
+    constexpr T& emplace(Args&&... args) {
+        destroy();
+        construct(std::forward<Args>(args)...);
+        return val;
     }
 
-    T& operator * () {
-        return *(reinterpret_cast<T *>(bytes));
+    [[nodiscard]] constexpr bool has_value() const {
+        return is_defined();
     }
 
-    const T& operator * () const {
-        return *(reinterpret_cast<const T *>(bytes));
+    constexpr T& operator * () {
+        return val;
     }
 
-    T * operator->() {
-        return reinterpret_cast<T *>(bytes);
+    constexpr const T& operator * () const {
+        return val;
     }
-    const T * operator->() const {
-        return reinterpret_cast<const T *>(bytes);
+
+    constexpr T * operator->() {
+        return std::addressof(val);
+    }
+    constexpr const T * operator->() const {
+        return std::addressof(val);
     }
 
-    T& value() {
-        if (defined) {
-            return *(reinterpret_cast<T *>(bytes));
+    constexpr T& value() {
+        if (is_defined()) {
+            return val;
         } else {
             throw BadOptionalAccess();
         }
     }
 
-    [[nodiscard]] const T& value() const {
-        if (defined) {
-            return *(reinterpret_cast<const T *>(bytes));
+    [[nodiscard]] constexpr const T& value() const {
+        if (is_defined()) {
+            return val;
         } else {
             throw BadOptionalAccess();
         }
     }
 
-    void reset() {
-        if (defined) reinterpret_cast<T *>(bytes)->~T();
-        defined = false;
-    }
-
-    ~Optional() {
-        if (defined) reinterpret_cast<T *>(bytes)->~T();
+    constexpr void reset() {
+        destroy();
     }
-};
\ No newline at end of file
+};
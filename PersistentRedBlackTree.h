@@ -0,0 +1,311 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+// Red-black tree for one writer and any number of lock-free readers. Nodes
+// are immutable once published: insert copies the O(log n) nodes on the
+// search path and shares the rest with the previous version through
+// reference counts. snapshot() pins the current version in O(1) and may be
+// called from any thread; insert, contains and size belong to the writer.
+//
+// Nodes have no parent pointers (a parent pointer would make every node
+// reachable from the path, so nothing could be shared), which is why this is
+// a separate class rather than a mode of RedBlackTree.
+template <typename T>
+class PersistentRedBlackTree {
+private:
+    struct Node {
+        static const bool black = true, red = false;
+
+        T val;
+        bool color;
+        Node* left;
+        Node* right;
+        size_t subtree;
+        std::atomic<uint32_t> refs{1};
+
+        Node(const T& val, bool color, Node* left, Node* right)
+                : val(val)
+                , color(color)
+                , left(left)
+                , right(right)
+                , subtree(1 + subtree_size(left) + subtree_size(right)) {}
+    };
+
+    static inline size_t subtree_size(const Node* node) {
+        return node ? node->subtree : 0;
+    }
+
+    static inline Node* acquire(Node* node) {
+        if (node) node->refs.fetch_add(1, std::memory_order_relaxed);
+        return node;
+    }
+
+    static void release(Node* node) {
+        while (node && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Node* right = node->right;
+            release(node->left);
+            delete node;
+            node = right;
+        }
+    }
+
+    static inline bool is_red(const Node* node) {
+        return node && node->color == Node::red;
+    }
+
+    static inline void update_size(Node* node) {
+        node->subtree = 1 + subtree_size(node->left) + subtree_size(node->right);
+    }
+
+    static bool contains_in(const Node* node, const T& val) {
+        while (node) {
+            if (val < node->val) {
+                node = node->left;
+            } else if (node->val < val) {
+                node = node->right;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template <typename F>
+    static void for_each_in(const Node* node, F& fn) {
+        for (; node; node = node->right) {
+            for_each_in(node->left, fn);
+            fn(node->val);
+        }
+    }
+
+    template <typename F>
+    static void for_each_in_range(const Node* node, const T& lo, const T& hi, F& fn) {
+        while (node) {
+            if (node->val < lo) {
+                node = node->right;
+            } else if (!(node->val < hi)) {
+                node = node->left;
+            } else {
+                for_each_in_range(node->left, lo, hi, fn);
+                fn(node->val);
+                node = node->right;
+            }
+        }
+    }
+
+    // Takes over the references to left and right, also when it throws.
+    static Node* make_node(const T& val, bool color, Node* left, Node* right) {
+        try {
+            return new Node(val, color, left, right);
+        } catch (...) {
+            release(left);
+            release(right);
+            throw;
+        }
+    }
+
+    // Red-red violations can only involve nodes on the search path, which
+    // are all fresh copies, so they are relinked in place.
+    static Node* balance_left(Node* node) {
+        Node* child = node->left;
+        if (node->color == Node::red || !is_red(child)) return node;
+        Node *x, *y, *z = node;
+        if (is_red(child->left)) {
+            x = child->left;
+            y = child;
+            z->left = y->right;
+        } else if (is_red(child->right)) {
+            x = child;
+            y = child->right;
+            x->right = y->left;
+            z->left = y->right;
+        } else {
+            return node;
+        }
+        return rebuild(x, y, z);
+    }
+
+    static Node* balance_right(Node* node) {
+        Node* child = node->right;
+        if (node->color == Node::red || !is_red(child)) return node;
+        Node *x = node, *y, *z;
+        if (is_red(child->left)) {
+            y = child->left;
+            z = child;
+            x->right = y->left;
+            z->left = y->right;
+        } else if (is_red(child->right)) {
+            y = child;
+            z = child->right;
+            x->right = y->left;
+        } else {
+            return node;
+        }
+        return rebuild(x, y, z);
+    }
+
+    static inline Node* rebuild(Node* x, Node* y, Node* z) {
+        x->color = z->color = Node::black;
+        y->color = Node::red;
+        y->left = x;
+        y->right = z;
+        update_size(x);
+        update_size(z);
+        update_size(y);
+        return y;
+    }
+
+    // Returns the new version of node with val inserted, or nullptr if val
+    // is already present.
+    static Node* insert_into(Node* node, const T& val) {
+        if (!node) return new Node(val, Node::red, nullptr, nullptr);
+        if (val < node->val) {
+            Node* left = insert_into(node->left, val);
+            if (!left) return nullptr;
+            return balance_left(make_node(node->val, node->color, left, acquire(node->right)));
+        }
+        if (node->val < val) {
+            Node* right = insert_into(node->right, val);
+            if (!right) return nullptr;
+            return balance_right(make_node(node->val, node->color, acquire(node->left), right));
+        }
+        return nullptr;
+    }
+
+    // Reclamation of replaced roots. A reader registers in readers[epoch & 1]
+    // before loading current and unregisters once it holds a reference. A
+    // retired root is released after two epoch flips, each followed by the
+    // previous parity draining, so every reader that could have loaded it
+    // is done. The writer never waits, it checks again on the next insert.
+    std::atomic<Node*> current{nullptr};
+    mutable std::atomic<size_t> epoch{0};
+    mutable std::atomic<size_t> readers[2] = {0, 0};
+    std::vector<Node*> retired, grace;
+    size_t flips_left = 0, wait_parity = 0;
+
+    inline void reclaim() {
+        for (;;) {
+            if (flips_left == 0) {
+                if (retired.empty()) return;
+                grace.swap(retired);
+                wait_parity = epoch.fetch_add(1) & 1;
+                flips_left = 2;
+            } else {
+                if (readers[wait_parity].load() != 0) return;
+                if (--flips_left == 1) {
+                    wait_parity = epoch.fetch_add(1) & 1;
+                } else {
+                    for (Node* node : grace) release(node);
+                    grace.clear();
+                }
+            }
+        }
+    }
+
+public:
+    // Immutable version of the tree. Copying it only bumps a reference
+    // count, and it stays valid after the tree itself is gone.
+    class Snapshot {
+    private:
+        Node* root = nullptr;
+
+        friend class PersistentRedBlackTree;
+
+        explicit Snapshot(Node* root)
+                : root(root) {}
+
+    public:
+        Snapshot() = default;
+
+        Snapshot(const Snapshot& other)
+                : root(acquire(other.root)) {}
+        Snapshot(Snapshot&& other) noexcept
+                : root(std::exchange(other.root, nullptr)) {}
+
+        Snapshot& operator=(Snapshot other) noexcept {
+            std::swap(root, other.root);
+            return *this;
+        }
+
+        ~Snapshot() {
+            release(root);
+        }
+
+        [[nodiscard]] inline size_t size() const {
+            return subtree_size(root);
+        }
+        [[nodiscard]] inline bool empty() const {
+            return root == nullptr;
+        }
+
+        inline bool contains(const T& val) const {
+            return contains_in(root, val);
+        }
+
+        // Calls fn(const T&) for every value in order.
+        template <typename F>
+        inline void for_each(F fn) const {
+            for_each_in(root, fn);
+        }
+
+        // Calls fn(const T&) in order for every value in [lo, hi).
+        template <typename F>
+        inline void for_each_in_range(const T& lo, const T& hi, F fn) const {
+            PersistentRedBlackTree::for_each_in_range(root, lo, hi, fn);
+        }
+    };
+
+    // Safe to call from any thread while the writer inserts. Never blocks,
+    // it retries only if an epoch flip races with its registration.
+    inline Snapshot snapshot() const {
+        size_t e;
+        for (;;) {
+            e = epoch.load();
+            readers[e & 1].fetch_add(1);
+            if (epoch.load() == e) break;
+            readers[e & 1].fetch_sub(1);
+        }
+        Node* root = acquire(current.load());
+        readers[e & 1].fetch_sub(1);
+        return Snapshot(root);
+    }
+
+    [[nodiscard]] inline size_t size() const {
+        return subtree_size(current.load(std::memory_order_relaxed));
+    }
+    [[nodiscard]] inline bool empty() const {
+        return current.load(std::memory_order_relaxed) == nullptr;
+    }
+
+    inline bool contains(const T& val) const {
+        return contains_in(current.load(std::memory_order_relaxed), val);
+    }
+
+    inline void insert(const T& val) {
+        Node* root = current.load(std::memory_order_relaxed);
+        Node* new_root = insert_into(root, val);
+        if (!new_root) return;
+        new_root->color = Node::black;
+        retired.reserve(retired.size() + 1);
+        current.store(new_root);
+        if (root) retired.push_back(root);
+        reclaim();
+    }
+
+    PersistentRedBlackTree() = default;
+    PersistentRedBlackTree(const PersistentRedBlackTree&) = delete;
+    PersistentRedBlackTree& operator=(const PersistentRedBlackTree&) = delete;
+
+    // No snapshot() call may be running, existing snapshots stay valid.
+    ~PersistentRedBlackTree() {
+        for (Node* node : retired) release(node);
+        for (Node* node : grace) release(node);
+        release(current.load());
+    }
+};
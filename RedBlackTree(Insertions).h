@@ -1,10 +1,201 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 
-template <typename T>
+// Node allocation policies for RedBlackTree. allocate() returns raw memory
+// for one node and deallocate() takes it back. With bulk_release set,
+// release() frees every node at once and the tree skips the per-node
+// deallocate calls when it is cleared. split() and join() move nodes between
+// trees: share() returns an allocator that keeps this one's nodes alive too,
+// adopt() takes over the nodes of another allocator.
+template <typename Node>
+class HeapNodeAllocator {
+public:
+    static constexpr bool bulk_release = false;
+
+    inline Node* allocate() {
+        return static_cast<Node*>(operator new(sizeof(Node)));
+    }
+    inline void deallocate(Node* node) {
+        operator delete(node);
+    }
+    inline void release() {}
+
+    inline HeapNodeAllocator share() const {
+        return {};
+    }
+    inline void adopt(HeapNodeAllocator&&) {}
+};
+
+// Hands out nodes from contiguous blocks that double in size up to
+// MAX_BLOCK_NODES nodes. Freed nodes go to the tree's own free list and are
+// reused first. The blocks belong to a lineage shared by every allocator
+// that share() or adopt() connected, so split and join hand nodes over in
+// O(1): share() copies one handle and adopt() splices one block list into
+// the other and leaves a forwarding link behind. A lineage frees its blocks
+// when the last of its trees is cleared or destroyed, so trees that keep
+// trading nodes keep each other's blocks alive; cells freed in one tree are
+// reused by another only once they are joined.
+template <typename Node>
+class SlabNodeAllocator {
+private:
+    union Cell {
+        Cell* next;
+        alignas(Node) unsigned char bytes[sizeof(Node)];
+    };
+
+    static constexpr size_t MIN_BLOCK_NODES = 16, MAX_BLOCK_NODES = 4096;
+
+    // Blocks are linked through their first cell. A lineage adopted by
+    // another one hands its blocks over and forwards to it.
+    struct Lineage {
+        Cell* blocks = nullptr;
+        Cell* blocks_tail = nullptr;
+        std::shared_ptr<Lineage> merged_into;
+
+        ~Lineage() {
+            while (blocks) {
+                delete[] std::exchange(blocks, blocks->next);
+            }
+            // unlinked one by one, a long forwarding chain must not recurse
+            std::shared_ptr<Lineage> next = std::move(merged_into);
+            while (next && next.use_count() == 1) {
+                next = std::move(next->merged_into);
+            }
+        }
+    };
+
+    // Guards the block lists and forwarding links of all lineages; it is
+    // taken once per new block and once per adopt(), never per node.
+    static inline std::mutex lineage_mutex;
+
+    std::shared_ptr<Lineage> lineage;
+    Cell* free_list = nullptr;
+    Cell* free_tail = nullptr;
+    Cell* bump = nullptr;
+    Cell* bump_end = nullptr;
+    size_t next_block_nodes = MIN_BLOCK_NODES;
+
+    // The lineage that owns the blocks now, with the handle moved to it.
+    // Requires lineage_mutex.
+    inline Lineage* resolve() {
+        while (lineage && lineage->merged_into) {
+            lineage = lineage->merged_into;
+        }
+        return lineage.get();
+    }
+
+    inline void add_block() {
+        Cell* block = new Cell[next_block_nodes + 1];
+        block->next = nullptr;
+        {
+            std::lock_guard lock(lineage_mutex);
+            if (!resolve()) {
+                lineage = std::make_shared<Lineage>();
+            }
+            (lineage->blocks ? lineage->blocks_tail->next : lineage->blocks) = block;
+            lineage->blocks_tail = block;
+        }
+        bump = block + 1;
+        bump_end = bump + next_block_nodes;
+        next_block_nodes = std::min(2 * next_block_nodes, MAX_BLOCK_NODES);
+    }
+
+public:
+    static constexpr bool bulk_release = true;
+
+    inline Node* allocate() {
+        if (free_list) {
+            Cell* cell = free_list;
+            free_list = cell->next;
+            return reinterpret_cast<Node*>(cell->bytes);
+        }
+        if (bump == bump_end) {
+            add_block();
+        }
+        return reinterpret_cast<Node*>((bump++)->bytes);
+    }
+
+    inline void deallocate(Node* node) {
+        Cell* cell = reinterpret_cast<Cell*>(node);
+        if (!free_list) free_tail = cell;
+        cell->next = free_list;
+        free_list = cell;
+    }
+
+    inline void release() {
+        lineage.reset();
+        free_list = free_tail = bump = bump_end = nullptr;
+        next_block_nodes = MIN_BLOCK_NODES;
+    }
+
+    // The new allocator owns no free cells, it only keeps the blocks alive.
+    inline SlabNodeAllocator share() const {
+        SlabNodeAllocator shared;
+        shared.lineage = lineage;
+        shared.next_block_nodes = next_block_nodes;
+        return shared;
+    }
+
+    // Free lists are spliced, of the two unused block tails the longer one
+    // is kept. O(1) apart from following forwarding links, which resolve()
+    // shortens as it goes.
+    inline void adopt(SlabNodeAllocator&& other) {
+        {
+            std::lock_guard lock(lineage_mutex);
+            Lineage* mine = resolve();
+            Lineage* theirs = other.resolve();
+            if (!mine) {
+                lineage = other.lineage;
+            } else if (theirs && theirs != mine) {
+                if (theirs->blocks) {
+                    (mine->blocks ? mine->blocks_tail->next : mine->blocks) = theirs->blocks;
+                    mine->blocks_tail = theirs->blocks_tail;
+                    theirs->blocks = theirs->blocks_tail = nullptr;
+                }
+                theirs->merged_into = lineage;
+            }
+        }
+        if (other.free_list) {
+            (free_list ? free_tail->next : free_list) = other.free_list;
+            free_tail = other.free_tail;
+        }
+        if (other.bump_end - other.bump > bump_end - bump) {
+            bump = other.bump;
+            bump_end = other.bump_end;
+        }
+        next_block_nodes = std::max(next_block_nodes, other.next_block_nodes);
+        other.release();
+    }
+};
+
+
+// Base of the tree nodes. With CountSubtrees every node also stores the size
+// of its subtree, which makes rank() and select() O(log n).
+template <bool CountSubtrees>
+struct RedBlackTreeNodeSize {};
+
+template <>
+struct RedBlackTreeNodeSize<true> {
+    size_t subtree = 1;
+};
+
+
+template <typename T, template <typename> class NodeAllocator = SlabNodeAllocator, bool CountSubtrees = false>
 class RedBlackTree {
 private:
-    struct Node {
+    struct Node : RedBlackTreeNodeSize<CountSubtrees> {
         using TreeNode = Node*;
         static const bool black = true, red = false;
 
@@ -15,20 +206,73 @@ private:
         explicit Node(const T& val, const TreeNode& parent = nullptr)
                 : val(val)
                 , parent(parent) {}
-
-        ~Node() {
-            delete left;
-            delete right;
-        }
     };
 
     using TreeNode = typename Node::TreeNode;
+
+    // Halves produced by split() do not know their size until it is asked
+    // for, counting them would make the split linear. With CountSubtrees
+    // the size is always known. size() const stores the count, so readers
+    // on several threads may race to store it; they all store the same
+    // value, relaxed atomics are enough.
+    static constexpr size_t UNKNOWN_SIZE = static_cast<size_t>(-1);
+
+    NodeAllocator<Node> allocator;
+    TreeNode root = nullptr;
+    mutable std::atomic<size_t> sz = 0;
+
+    inline size_t known_size() const {
+        return sz.load(std::memory_order_relaxed);
+    }
+    inline void set_size(size_t n) const {
+        sz.store(n, std::memory_order_relaxed);
+    }
+
     inline TreeNode create_node(const T& val, const TreeNode& parent = nullptr) {
-        return new Node(val, parent);
+        TreeNode node = allocator.allocate();
+        try {
+            new (node) Node(val, parent);
+        } catch (...) {
+            allocator.deallocate(node);
+            throw;
+        }
+        return node;
     }
 
-    TreeNode root = nullptr;
-    size_t sz = 0;
+    inline void destroy_node(TreeNode node) {
+        node->~Node();
+        allocator.deallocate(node);
+    }
+
+    // Post-order walk over parent pointers, so deep trees cannot overflow
+    // the stack. Skipped entirely when the allocator can drop all nodes at
+    // once and there are no destructors to run.
+    inline void destroy_all() {
+        if constexpr (!NodeAllocator<Node>::bulk_release || !std::is_trivially_destructible_v<T>) {
+            TreeNode node = root;
+            while (node) {
+                if (node->left) {
+                    node = node->left;
+                } else if (node->right) {
+                    node = node->right;
+                } else {
+                    TreeNode parent = node->parent;
+                    if (parent) {
+                        (parent->left == node ? parent->left : parent->right) = nullptr;
+                    }
+                    if constexpr (NodeAllocator<Node>::bulk_release) {
+                        node->~Node();
+                    } else {
+                        destroy_node(node);
+                    }
+                    node = parent;
+                }
+            }
+        }
+        allocator.release();
+        root = nullptr;
+        set_size(0);
+    }
 
     inline TreeNode almost_find(const T& val) const {
         TreeNode current = root, parent = nullptr;
@@ -51,6 +295,59 @@ private:
         return is_left_child(node) ? node->parent->right : node->parent->left;
     }
 
+    static inline TreeNode minimum(TreeNode node) {
+        while (node->left) node = node->left;
+        return node;
+    }
+    static inline TreeNode maximum(TreeNode node) {
+        while (node->right) node = node->right;
+        return node;
+    }
+
+    static inline TreeNode successor(TreeNode node) {
+        if (node->right) return minimum(node->right);
+        while (node->parent && is_right_child(node)) node = node->parent;
+        return node->parent;
+    }
+    static inline TreeNode predecessor(TreeNode node) {
+        if (node->left) return maximum(node->left);
+        while (node->parent && is_left_child(node)) node = node->parent;
+        return node->parent;
+    }
+
+    static inline bool is_black(const TreeNode& node) {
+        return !node || node->color == Node::black;
+    }
+
+    // First node whose value is not less than val (or, with strict, greater
+    // than val).
+    template <bool strict>
+    inline TreeNode bound(const T& val) const {
+        TreeNode current = root, result = nullptr;
+        while (current) {
+            if (strict ? val < current->val : !(current->val < val)) {
+                result = current;
+                current = current->left;
+            } else {
+                current = current->right;
+            }
+        }
+        return result;
+    }
+
+    static inline size_t subtree_size(const TreeNode& node) {
+        return node ? node->subtree : 0;
+    }
+    static inline void update_size(TreeNode node) {
+        node->subtree = 1 + subtree_size(node->left) + subtree_size(node->right);
+    }
+    // Recomputes the sizes from node up to the root.
+    static inline void update_sizes_upwards(TreeNode node) {
+        for (; node; node = node->parent) {
+            update_size(node);
+        }
+    }
+
     inline void rotate_left(TreeNode node) {
         if (auto parent = node->parent) {
             if (is_left_child(node)) {
@@ -66,6 +363,10 @@ private:
         node->right = node->parent->left;
         if (node->right) node->right->parent = node;
         node->parent->left = node;
+        if constexpr (CountSubtrees) {
+            node->parent->subtree = node->subtree;
+            update_size(node);
+        }
     }
     inline void rotate_right(TreeNode node) {
         if (node->parent) {
@@ -82,9 +383,14 @@ private:
         node->left = node->parent->right;
         if (node->left) node->left->parent = node;
         node->parent->right = node;
+        if constexpr (CountSubtrees) {
+            node->parent->subtree = node->subtree;
+            update_size(node);
+        }
     }
 
-    inline void rebalance_from(TreeNode node) {
+    // Returns true if the black height of the tree grew.
+    inline bool rebalance_from(TreeNode node) {
         while (node != root && node->parent->color == Node::red) {
             if (TreeNode uncle = find_brother(node->parent); uncle && uncle->color == Node::red) {
                 node->parent->color = uncle->color = Node::black;
@@ -110,19 +416,373 @@ private:
                 }
             }
         }
+        bool grew = root->color == Node::red;
         root->color = Node::black;
+        return grew;
+    }
+
+    static inline size_t black_height(TreeNode node) {
+        size_t height = 0;
+        for (; node; node = node->left) {
+            height += node->color == Node::black;
+        }
+        return height;
+    }
+
+    // Makes child the black root of a tree of its own, adjusting height.
+    static inline TreeNode detach(TreeNode child, size_t& height) {
+        if (child) {
+            child->parent = nullptr;
+            if (child->color == Node::red) {
+                child->color = Node::black;
+                ++height;
+            }
+        }
+        return child;
+    }
+
+    // Links the trees rooted at left and right under pivot, where left and
+    // right have black roots and the given black heights. pivot goes down
+    // the spine of the taller tree to the first black node of the other's
+    // height, so the cost is the difference of the heights. Returns the new
+    // root and stores its black height in height. Uses root as scratch.
+    inline TreeNode join_roots(TreeNode left, size_t left_height, TreeNode pivot,
+                               TreeNode right, size_t right_height, size_t& height) {
+        pivot->left = pivot->right = nullptr;
+        if (left_height == right_height) {
+            pivot->left = left;
+            pivot->right = right;
+            if (left) left->parent = pivot;
+            if (right) right->parent = pivot;
+            pivot->parent = nullptr;
+            pivot->color = Node::black;
+            if constexpr (CountSubtrees) update_size(pivot);
+            height = left_height + 1;
+            return root = pivot;
+        }
+
+        bool left_taller = left_height > right_height;
+        TreeNode current = left_taller ? left : right, parent = nullptr;
+        size_t current_height = left_taller ? left_height : right_height;
+        size_t target_height = left_taller ? right_height : left_height;
+        while (!is_black(current) || current_height != target_height) {
+            current_height -= current->color == Node::black;
+            parent = current;
+            current = left_taller ? current->right : current->left;
+        }
+        pivot->parent = parent;
+        pivot->color = Node::red;
+        if (left_taller) {
+            parent->right = pivot;
+            pivot->left = current;
+            pivot->right = right;
+        } else {
+            parent->left = pivot;
+            pivot->left = left;
+            pivot->right = current;
+        }
+        if (pivot->left) pivot->left->parent = pivot;
+        if (pivot->right) pivot->right->parent = pivot;
+        if constexpr (CountSubtrees) update_sizes_upwards(pivot);
+
+        root = left_taller ? left : right;
+        height = (left_taller ? left_height : right_height) + rebalance_from(pivot);
+        return root;
+    }
+
+    struct Split {
+        TreeNode left = nullptr, right = nullptr;
+        size_t left_height = 0, right_height = 0;
+    };
+
+    // Every level rejoins the side it cut off, the black heights of those
+    // joins telescope, so the whole split is O(log n).
+    inline Split split_node(TreeNode node, size_t height, const T& key) {
+        if (!node) return {};
+        size_t left_height = height - (node->color == Node::black), right_height = left_height;
+        TreeNode left = detach(node->left, left_height), right = detach(node->right, right_height);
+        if (node->val < key) {
+            Split parts = split_node(right, right_height, key);
+            parts.left = join_roots(left, left_height, node, parts.left, parts.left_height, parts.left_height);
+            return parts;
+        }
+        Split parts = key < node->val ? split_node(left, left_height, key) : Split{left, nullptr, left_height, 0};
+        parts.right = join_roots(parts.right, parts.right_height, node, right, right_height, parts.right_height);
+        return parts;
+    }
+
+    // Midpoint splits keep every level but the deepest full, so colouring
+    // that level red and everything else black is a valid red-black tree.
+    static TreeNode build(const std::vector<TreeNode>& nodes, size_t from, size_t to,
+                          size_t depth, size_t red_depth, TreeNode parent) {
+        if (from == to) return nullptr;
+        size_t middle = from + (to - from) / 2;
+        TreeNode node = nodes[middle];
+        node->parent = parent;
+        node->color = depth == red_depth ? Node::red : Node::black;
+        node->left = build(nodes, from, middle, depth + 1, red_depth, node);
+        node->right = build(nodes, middle + 1, to, depth + 1, red_depth, node);
+        if constexpr (CountSubtrees) node->subtree = to - from;
+        return node;
+    }
+
+    inline void transplant(TreeNode node, TreeNode child) {
+        if (!node->parent) {
+            root = child;
+        } else if (is_left_child(node)) {
+            node->parent->left = child;
+        } else {
+            node->parent->right = child;
+        }
+        if (child) child->parent = node->parent;
+    }
+
+    // Unlinks node and restores the red-black properties. Nodes are relinked
+    // rather than having their values swapped, so iterators to every other
+    // node stay valid.
+    inline void erase_node(TreeNode node) {
+        bool removed_color = node->color;
+        TreeNode child, parent;
+        if (!node->left) {
+            child = node->right;
+            parent = node->parent;
+            transplant(node, child);
+        } else if (!node->right) {
+            child = node->left;
+            parent = node->parent;
+            transplant(node, child);
+        } else {
+            TreeNode next = minimum(node->right);
+            removed_color = next->color;
+            child = next->right;
+            if (next->parent == node) {
+                parent = next;
+            } else {
+                parent = next->parent;
+                transplant(next, child);
+                next->right = node->right;
+                next->right->parent = next;
+            }
+            transplant(node, next);
+            next->left = node->left;
+            next->left->parent = next;
+            next->color = node->color;
+        }
+        if constexpr (CountSubtrees) update_sizes_upwards(parent);
+        destroy_node(node);
+        if (size_t n = known_size(); n != UNKNOWN_SIZE) set_size(n - 1);
+        if (removed_color == Node::black) {
+            rebalance_after_erase(child, parent);
+        }
+    }
+
+    // child carries an extra black and may be null, hence the separate parent.
+    inline void rebalance_after_erase(TreeNode child, TreeNode parent) {
+        while (child != root && is_black(child)) {
+            if (child == parent->left) {
+                TreeNode brother = parent->right;
+                if (brother->color == Node::red) {
+                    brother->color = Node::black;
+                    parent->color = Node::red;
+                    rotate_left(parent);
+                    brother = parent->right;
+                }
+                if (is_black(brother->left) && is_black(brother->right)) {
+                    brother->color = Node::red;
+                    child = parent;
+                    parent = child->parent;
+                } else {
+                    if (is_black(brother->right)) {
+                        brother->left->color = Node::black;
+                        brother->color = Node::red;
+                        rotate_right(brother);
+                        brother = parent->right;
+                    }
+                    brother->color = parent->color;
+                    parent->color = Node::black;
+                    brother->right->color = Node::black;
+                    rotate_left(parent);
+                    child = root;
+                }
+            } else {
+                TreeNode brother = parent->left;
+                if (brother->color == Node::red) {
+                    brother->color = Node::black;
+                    parent->color = Node::red;
+                    rotate_right(parent);
+                    brother = parent->left;
+                }
+                if (is_black(brother->left) && is_black(brother->right)) {
+                    brother->color = Node::red;
+                    child = parent;
+                    parent = child->parent;
+                } else {
+                    if (is_black(brother->left)) {
+                        brother->right->color = Node::black;
+                        brother->color = Node::red;
+                        rotate_left(brother);
+                        brother = parent->left;
+                    }
+                    brother->color = parent->color;
+                    parent->color = Node::black;
+                    brother->left->color = Node::black;
+                    rotate_right(parent);
+                    child = root;
+                }
+            }
+        }
+        if (child) child->color = Node::black;
     }
 
 public:
+    // Bidirectional, in order. Elements cannot be modified through it, since
+    // that could break the ordering. end() is a null node, decrementing it
+    // goes to the largest element.
+    class iterator {
+    private:
+        TreeNode node = nullptr;
+        const RedBlackTree* tree = nullptr;
+
+        friend class RedBlackTree;
+
+        iterator(TreeNode node, const RedBlackTree* tree)
+                : node(node)
+                , tree(tree) {}
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        iterator() = default;
+
+        inline reference operator*() const {
+            return node->val;
+        }
+        inline pointer operator->() const {
+            return &node->val;
+        }
+
+        inline iterator& operator++() {
+            node = successor(node);
+            return *this;
+        }
+        inline iterator operator++(int) {
+            iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+        inline iterator& operator--() {
+            node = node ? predecessor(node) : maximum(tree->root);
+            return *this;
+        }
+        inline iterator operator--(int) {
+            iterator copy = *this;
+            --*this;
+            return copy;
+        }
+
+        inline bool operator==(const iterator& other) const {
+            return node == other.node;
+        }
+        inline bool operator!=(const iterator& other) const {
+            return node != other.node;
+        }
+    };
+
+    using const_iterator = iterator;
+
+    inline iterator begin() const {
+        return iterator(root ? minimum(root) : nullptr, this);
+    }
+    inline iterator end() const {
+        return iterator(nullptr, this);
+    }
+
+    inline iterator find(const T& val) const {
+        TreeNode node = empty() ? nullptr : almost_find(val);
+        return iterator(node && node->val == val ? node : nullptr, this);
+    }
+
+    inline iterator lower_bound(const T& val) const {
+        return iterator(bound<false>(val), this);
+    }
+    inline iterator upper_bound(const T& val) const {
+        return iterator(bound<true>(val), this);
+    }
+    inline std::pair<iterator, iterator> equal_range(const T& val) const {
+        return {lower_bound(val), upper_bound(val)};
+    }
+
+    // Calls fn(const T&) in order for every element in [lo, hi). Subtrees
+    // entirely outside the range are never entered.
+    template <typename F>
+    inline void for_each_in_range(const T& lo, const T& hi, F fn) const {
+        for (TreeNode node = bound<false>(lo); node && node->val < hi; node = successor(node)) {
+            fn(node->val);
+        }
+    }
+
+    // Returns the iterator following the erased element.
+    inline iterator erase(iterator pos) {
+        TreeNode next = successor(pos.node);
+        erase_node(pos.node);
+        return iterator(next, this);
+    }
+    inline size_t erase(const T& val) {
+        iterator pos = find(val);
+        if (pos == end()) return 0;
+        erase_node(pos.node);
+        return 1;
+    }
+
+    // Number of values less than val.
+    inline size_t rank(const T& val) const {
+        static_assert(CountSubtrees, "rank() needs CountSubtrees");
+        size_t result = 0;
+        for (TreeNode node = root; node;) {
+            if (node->val < val) {
+                result += subtree_size(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return result;
+    }
+
+    // The k-th smallest value, counting from zero, or end() if k >= size().
+    inline iterator select(size_t k) const {
+        static_assert(CountSubtrees, "select() needs CountSubtrees");
+        TreeNode node = root;
+        while (node) {
+            size_t left_size = subtree_size(node->left);
+            if (k == left_size) break;
+            if (k < left_size) {
+                node = node->left;
+            } else {
+                k -= left_size + 1;
+                node = node->right;
+            }
+        }
+        return iterator(node, this);
+    }
+
     [[nodiscard]] inline size_t size() const {
-        return sz;
+        size_t n = known_size();
+        if (n == UNKNOWN_SIZE) {
+            n = std::distance(begin(), end());
+            set_size(n);
+        }
+        return n;
     }
     [[nodiscard]] inline bool empty() const {
         return root == nullptr;
     }
     inline void clear() {
-        root = nullptr;
-        sz = 0;
+        destroy_all();
     }
 
     inline bool contains(const T& val) const {
@@ -132,7 +792,7 @@ public:
     inline void insert(const T& val) {
         if (empty()) {
             rebalance_from(root = create_node(val));
-            ++sz;
+            set_size(1);
         }
 
         TreeNode parent = almost_find(val);
@@ -144,12 +804,112 @@ public:
         } else {
             parent->right = new_node;
         }
-        ++sz;
+        if (size_t n = known_size(); n != UNKNOWN_SIZE) set_size(n + 1);
+        if constexpr (CountSubtrees) {
+            for (TreeNode node = parent; node; node = node->parent) {
+                ++node->subtree;
+            }
+        }
 
         rebalance_from(new_node);
     }
 
+    // Builds the tree from sorted values in linear time, equal neighbours are
+    // kept once. Throws std::invalid_argument if the range is not sorted.
+    template <typename Iter>
+    static RedBlackTree from_sorted(Iter first, Iter last) {
+        RedBlackTree tree;
+        std::vector<TreeNode> nodes;
+        try {
+            for (; first != last; ++first) {
+                if (!nodes.empty() && !(nodes.back()->val < *first)) {
+                    if (*first < nodes.back()->val) throw std::invalid_argument("range is not sorted");
+                    continue;
+                }
+                nodes.push_back(nullptr);
+                nodes.back() = tree.create_node(*first);
+            }
+        } catch (...) {
+            for (TreeNode node : nodes) {
+                if (node) tree.destroy_node(node);
+            }
+            throw;
+        }
+        tree.root = build(nodes, 0, nodes.size(), 0, std::bit_width(nodes.size() + 1) - 1, nullptr);
+        tree.set_size(nodes.size());
+        return tree;
+    }
+
+    // All values of left must be less than pivot and all values of right
+    // greater, otherwise std::invalid_argument is thrown. Both trees are
+    // left empty. O(log n) plus an O(1) allocator handoff, see
+    // SlabNodeAllocator.
+    static RedBlackTree join(RedBlackTree&& left, const T& pivot, RedBlackTree&& right) {
+        if ((left.root && !(maximum(left.root)->val < pivot))
+                || (right.root && !(pivot < minimum(right.root)->val))) {
+            throw std::invalid_argument("trees overlap the pivot");
+        }
+        RedBlackTree result(std::move(left));
+        TreeNode middle = result.create_node(pivot);
+        result.allocator.adopt(std::move(right.allocator));
+        size_t height;
+        result.root = result.join_roots(result.root, black_height(result.root), middle,
+                                        right.root, black_height(right.root), height);
+        size_t left_size = result.known_size(), right_size = right.known_size();
+        result.set_size(left_size == UNKNOWN_SIZE || right_size == UNKNOWN_SIZE
+                ? UNKNOWN_SIZE : left_size + right_size + 1);
+        right.root = nullptr;
+        right.set_size(0);
+        return result;
+    }
+
+    // Moves the values less than key into the first tree and the rest into
+    // the second, leaving this one empty. O(log n) plus an O(1) allocator
+    // handoff, see SlabNodeAllocator; without CountSubtrees the sizes of the
+    // halves are counted on the first call to size().
+    std::pair<RedBlackTree, RedBlackTree> split(const T& key) {
+        Split parts = split_node(root, black_height(root), key);
+        std::pair<RedBlackTree, RedBlackTree> result;
+        std::swap(result.first.allocator, allocator);
+        result.second.allocator = result.first.allocator.share();
+        result.first.root = parts.left;
+        result.second.root = parts.right;
+        if constexpr (CountSubtrees) {
+            result.first.set_size(subtree_size(parts.left));
+            result.second.set_size(subtree_size(parts.right));
+        } else {
+            result.first.set_size(parts.left ? UNKNOWN_SIZE : 0);
+            result.second.set_size(parts.right ? UNKNOWN_SIZE : 0);
+        }
+        root = nullptr;
+        set_size(0);
+        return result;
+    }
+
+    inline void swap(RedBlackTree& other) noexcept {
+        std::swap(allocator, other.allocator);
+        std::swap(root, other.root);
+        size_t n = known_size();
+        set_size(other.known_size());
+        other.set_size(n);
+    }
+
+    RedBlackTree() = default;
+    RedBlackTree(const RedBlackTree&) = delete;
+    RedBlackTree& operator=(const RedBlackTree&) = delete;
+
+    RedBlackTree(RedBlackTree&& other) noexcept {
+        swap(other);
+    }
+    RedBlackTree& operator=(RedBlackTree&& other) noexcept {
+        if (this != &other) {
+            destroy_all();
+            swap(other);
+        }
+        return *this;
+    }
+
     ~RedBlackTree() {
-        delete root;
+        destroy_all();
     }
 };
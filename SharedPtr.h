@@ -1,38 +1,174 @@
+#pragma once
+
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Shared state of all SharedPtrs and WeakPtrs to one object. The owners
+// together hold one weak reference, so the block outlives the object for
+// as long as a WeakPtr may still look at strong.
+struct SharedControlBlock {
+    std::atomic<size_t> strong{1};
+    std::atomic<size_t> weak{1};
+
+    virtual void destroy_object() noexcept = 0;
+
+    // The object, for AtomicSharedPtr, which only stores the block.
+    virtual void * object() noexcept = 0;
+
+    virtual ~SharedControlBlock() = default;
+
+    void add_strong(size_t count = 1) noexcept {
+        strong.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Fails once the object is gone, used by WeakPtr::lock.
+    bool add_strong_if_alive() noexcept {
+        size_t count = strong.load(std::memory_order_relaxed);
+        while (count != 0) {
+            if (strong.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel,
+                                             std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void add_weak() noexcept {
+        weak.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release_strong(size_t count = 1) noexcept {
+        if (strong.fetch_sub(count, std::memory_order_acq_rel) == count) {
+            destroy_object();
+            release_weak();
+        }
+    }
+
+    void release_weak() noexcept {
+        if (weak.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+};
 
+// Block for an object allocated separately, SharedPtr(new T(...)).
 template <typename T>
+struct PointerControlBlock: SharedControlBlock {
+    T * ptr;
+
+    explicit PointerControlBlock(T * ptr) noexcept: ptr(ptr) {}
+
+    void destroy_object() noexcept override {
+        delete ptr;
+    }
+
+    void * object() noexcept override {
+        return ptr;
+    }
+};
+
+// Block holding the object itself, made by MakeShared: one allocation, and
+// the counters share cache lines with the object.
+template <typename T>
+struct InlineControlBlock: SharedControlBlock {
+    alignas(T) unsigned char bytes[sizeof(T)];
+
+    template <typename... Args>
+    explicit InlineControlBlock(Args&&... args) {
+        new (bytes) T(std::forward<Args>(args)...);
+    }
+
+    T * get() noexcept {
+        return std::launder(reinterpret_cast<T *>(bytes));
+    }
+
+    void destroy_object() noexcept override {
+        get()->~T();
+    }
+
+    void * object() noexcept override {
+        return get();
+    }
+};
+
+// How SharedPtr counts references, chosen by its second template argument.
+// ControlBlockCount keeps atomic counts in a separate control block and
+// is the only mode with WeakPtr and AtomicSharedPtr support.
+// IntrusiveCount and BiasedCount are defined further down.
+struct ControlBlockCount {};
+struct IntrusiveCount;
+struct BiasedCount;
+
+template <typename T, typename Count = ControlBlockCount>
+class SharedPtr;
+
+template <typename T, typename Count = ControlBlockCount, typename... Args>
+SharedPtr<T, Count> MakeShared(Args&&... args);
+
+template <typename T>
+class WeakPtr;
+
+template <typename T>
+class AtomicSharedPtr;
+
+// Reference counts are atomic, so copies of one SharedPtr may be made and
+// destroyed on different threads. A single SharedPtr object is not safe
+// to modify from several threads at once.
+template <typename T, typename Count>
 class SharedPtr {
-public:
+private:
     T * ptr = nullptr;
-    size_t * cnt = new size_t(1);
+    SharedControlBlock * cnt = nullptr;
 
-    void suicide() {
-        --*cnt;
-        if (*cnt == 0) {
-            delete ptr;
-            delete cnt;
-        }
+    SharedPtr(T * ptr, SharedControlBlock * cnt) noexcept: ptr(ptr), cnt(cnt) {}
+
+    void suicide() noexcept {
+        if (cnt) cnt->release_strong();
+    }
+
+    friend class WeakPtr<T>;
+    friend class AtomicSharedPtr<T>;
+
+    template <typename U, typename C, typename... Args>
+    friend SharedPtr<U, C> MakeShared(Args&&... args);
+
+    template <typename... Args>
+    static SharedPtr make(Args&&... args) {
+        auto * block = new InlineControlBlock<T>(std::forward<Args>(args)...);
+        return SharedPtr(block->get(), block);
     }
 
 public:
     SharedPtr() = default;
-    explicit SharedPtr(T * new_ptr) noexcept: ptr(new_ptr) {}
-    explicit SharedPtr(std::nullptr_t null_ptr) noexcept: ptr(null_ptr) {}
+    explicit SharedPtr(T * new_ptr): ptr(new_ptr) {
+        if (!new_ptr) return;
+        try {
+            cnt = new PointerControlBlock<T>(new_ptr);
+        } catch (...) {
+            delete new_ptr;
+            throw;
+        }
+    }
+    explicit SharedPtr(std::nullptr_t) noexcept {}
     SharedPtr(const SharedPtr& other) noexcept: ptr(other.ptr), cnt(other.cnt) {
-        ++*cnt;
+        if (cnt) cnt->add_strong();
     }
     SharedPtr(SharedPtr&& other) noexcept: ptr(other.ptr), cnt(other.cnt) {
         other.ptr = nullptr;
-        other.cnt = new size_t(1);
+        other.cnt = nullptr;
     }
 
     SharedPtr& operator= (const SharedPtr& other) noexcept {
         if (this == &other) {
             return *this;
         }
+        if (other.cnt) other.cnt->add_strong();
         suicide();
         this->cnt = other.cnt;
-        ++*cnt;
         this->ptr = other.ptr;
         return *this;
     }
@@ -41,18 +177,199 @@ public:
             return *this;
         }
         suicide();
-        this->cnt = other.cnt;
-        this->ptr = other.ptr;
-        other.cnt = new size_t(1);
+        this->cnt = std::exchange(other.cnt, nullptr);
+        this->ptr = std::exchange(other.ptr, nullptr);
+        return *this;
+    }
+    SharedPtr& operator= (T * new_ptr) {
+        *this = SharedPtr(new_ptr);
+        return *this;
+    }
+    SharedPtr& operator= (std::nullptr_t) noexcept {
+        suicide();
+        ptr = nullptr;
+        cnt = nullptr;
+        return *this;
+    }
+
+    ~SharedPtr() noexcept {
+        suicide();
+    }
+
+    T& operator * () noexcept {
+        return *ptr;
+    }
+    const T& operator * () const noexcept {
+        return *ptr;
+    }
+    const T * operator -> () const noexcept {
+        return ptr;
+    }
+
+    void reset(T * other) {
+        *this = SharedPtr(other);
+    }
+
+    void swap(SharedPtr& other) noexcept {
+        std::swap(ptr, other.ptr);
+        std::swap(cnt, other.cnt);
+    }
+
+    T * get() const noexcept {
+        return ptr;
+    }
+
+    // Only a hint when other threads hold copies.
+    [[nodiscard]] size_t use_count() const noexcept {
+        return cnt ? cnt->strong.load(std::memory_order_relaxed) : 0;
+    }
+
+    explicit operator bool() const noexcept {
+        return ptr != nullptr;
+    }
+};
+
+// Creates the object and its counters in a single allocation.
+template <typename T, typename Count, typename... Args>
+SharedPtr<T, Count> MakeShared(Args&&... args) {
+    return SharedPtr<T, Count>::make(std::forward<Args>(args)...);
+}
+
+// Observes an object owned by SharedPtrs without keeping it alive. lock()
+// gives a SharedPtr to it, or an empty one once the last owner is gone.
+template <typename T>
+class WeakPtr {
+private:
+    T * ptr = nullptr;
+    SharedControlBlock * cnt = nullptr;
+
+    void suicide() noexcept {
+        if (cnt) cnt->release_weak();
+    }
+
+public:
+    WeakPtr() = default;
+    WeakPtr(const SharedPtr<T>& shared) noexcept: ptr(shared.ptr), cnt(shared.cnt) {
+        if (cnt) cnt->add_weak();
+    }
+    WeakPtr(const WeakPtr& other) noexcept: ptr(other.ptr), cnt(other.cnt) {
+        if (cnt) cnt->add_weak();
+    }
+    WeakPtr(WeakPtr&& other) noexcept: ptr(other.ptr), cnt(other.cnt) {
         other.ptr = nullptr;
+        other.cnt = nullptr;
+    }
+
+    WeakPtr& operator= (WeakPtr other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~WeakPtr() noexcept {
+        suicide();
+    }
+
+    [[nodiscard]] SharedPtr<T> lock() const noexcept {
+        if (cnt && cnt->add_strong_if_alive()) {
+            return SharedPtr<T>(ptr, cnt);
+        }
+        return SharedPtr<T>();
+    }
+
+    [[nodiscard]] bool expired() const noexcept {
+        return !cnt || cnt->strong.load(std::memory_order_acquire) == 0;
+    }
+
+    void reset() noexcept {
+        suicide();
+        ptr = nullptr;
+        cnt = nullptr;
+    }
+
+    void swap(WeakPtr& other) noexcept {
+        std::swap(ptr, other.ptr);
+        std::swap(cnt, other.cnt);
+    }
+};
+
+// Intrusive mode: T derives from IntrusiveRefCounted and carries the count
+// itself, so there is no control block and SharedPtr<T, IntrusiveCount> is
+// a single pointer. Any T * to such an object can be turned into another
+// owner.
+struct IntrusiveCount {};
+
+class IntrusiveRefCounted {
+private:
+    mutable std::atomic<size_t> refs{0};
+
+    template <typename T, typename Count>
+    friend class SharedPtr;
+
+protected:
+    IntrusiveRefCounted() = default;
+    // a copy of the object is not shared by anyone yet
+    IntrusiveRefCounted(const IntrusiveRefCounted&) noexcept {}
+    IntrusiveRefCounted& operator= (const IntrusiveRefCounted&) noexcept {
+        return *this;
+    }
+    ~IntrusiveRefCounted() = default;
+};
+
+template <typename T>
+class SharedPtr<T, IntrusiveCount> {
+private:
+    T * ptr = nullptr;
+
+    static void acquire(T * p) noexcept {
+        static_assert(std::is_base_of_v<IntrusiveRefCounted, T>, "T must derive from IntrusiveRefCounted");
+        if (p) p->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void suicide() noexcept {
+        if (ptr && ptr->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete ptr;
+        }
+    }
+
+    template <typename U, typename C, typename... Args>
+    friend SharedPtr<U, C> MakeShared(Args&&... args);
+
+    template <typename... Args>
+    static SharedPtr make(Args&&... args) {
+        return SharedPtr(new T(std::forward<Args>(args)...));
+    }
+
+public:
+    SharedPtr() = default;
+    explicit SharedPtr(T * new_ptr) noexcept: ptr(new_ptr) {
+        acquire(ptr);
+    }
+    explicit SharedPtr(std::nullptr_t) noexcept {}
+    SharedPtr(const SharedPtr& other) noexcept: ptr(other.ptr) {
+        acquire(ptr);
+    }
+    SharedPtr(SharedPtr&& other) noexcept: ptr(std::exchange(other.ptr, nullptr)) {}
+
+    SharedPtr& operator= (const SharedPtr& other) noexcept {
+        acquire(other.ptr);
+        suicide();
+        ptr = other.ptr;
+        return *this;
+    }
+    SharedPtr& operator= (SharedPtr&& other) noexcept {
+        if (this != &other) {
+            suicide();
+            ptr = std::exchange(other.ptr, nullptr);
+        }
         return *this;
     }
     SharedPtr& operator= (T * new_ptr) noexcept {
         *this = SharedPtr(new_ptr);
         return *this;
     }
-    SharedPtr& operator= (std::nullptr_t null_ptr) noexcept {
-        *this = SharedPtr(null_ptr);
+    SharedPtr& operator= (std::nullptr_t) noexcept {
+        suicide();
+        ptr = nullptr;
         return *this;
     }
 
@@ -74,7 +391,337 @@ public:
         *this = SharedPtr(other);
     }
 
-    void swap(SharedPtr& other) {
+    void swap(SharedPtr& other) noexcept {
+        std::swap(ptr, other.ptr);
+    }
+
+    T * get() const noexcept {
+        return ptr;
+    }
+
+    [[nodiscard]] size_t use_count() const noexcept {
+        return ptr ? ptr->refs.load(std::memory_order_relaxed) : 0;
+    }
+
+    explicit operator bool() const noexcept {
+        return ptr != nullptr;
+    }
+};
+
+// Biased mode, for objects mostly shared within the thread that created
+// them. That thread, the owner, counts its references in a plain integer;
+// all other threads use an atomic counter. Once the owner's count drops
+// to zero it merges it into the atomic one and the object is freed when
+// that reaches zero.
+//
+// A reference taken on the owner thread may be dropped on another thread,
+// which pushes the atomic count below zero. That thread then queues the
+// object with the owner, who merges it the next time it creates a biased
+// object, drops its last reference to one, calls BiasedCount::collect(),
+// or exits. So a dropped object may wait until then to be freed.
+struct BiasedControlBlock {
+    // shared is count * ONE + QUEUED + MERGED, with a signed count
+    static constexpr int64_t MERGED = 1, QUEUED = 2, ONE = 4;
+
+    std::atomic<int64_t> shared{0};
+    struct BiasedOwner * owner = nullptr;
+    BiasedControlBlock * next_queued = nullptr;
+
+    // the rest belongs to the owner thread
+    size_t biased = 1;
+    bool merged = false;
+    BiasedControlBlock * prev_owned = nullptr, * next_owned = nullptr;
+
+    BiasedControlBlock() = default;
+
+    BiasedControlBlock(const BiasedControlBlock&) = delete;
+    BiasedControlBlock& operator= (const BiasedControlBlock&) = delete;
+
+    // destroys the object
+    virtual ~BiasedControlBlock() = default;
+
+    static void destroy(BiasedControlBlock * block) noexcept;
+
+    // Hands the new block, holding the creator's reference, to the calling
+    // thread. Called once the object is constructed.
+    void start() noexcept;
+
+    void add() noexcept;
+    void release() noexcept;
+};
+
+// Per-thread state of an owner, kept alive by its thread and by every
+// block it owns.
+struct BiasedOwner {
+    // blocks queued by other threads, CLOSED once the thread is gone
+    std::atomic<BiasedControlBlock *> inbox{nullptr};
+    std::atomic<size_t> refs{1};
+    // unmerged blocks of this owner, only touched by its thread
+    BiasedControlBlock * owned = nullptr;
+
+    static inline BiasedControlBlock * const CLOSED = reinterpret_cast<BiasedControlBlock *>(alignof(BiasedControlBlock));
+
+    // trivially destructible, so reading them works during thread exit
+    static inline thread_local BiasedOwner * current_owner = nullptr;
+    static inline thread_local bool exited = false;
+
+    struct ThreadExit {
+        ~ThreadExit() {
+            BiasedOwner * owner = current_owner;
+            current_owner = nullptr;
+            exited = true;
+            if (owner) owner->close();
+        }
+    };
+
+    // The owner for blocks created on this thread, nullptr while the
+    // thread exits or if there is no memory for it.
+    static BiasedOwner * current() noexcept {
+        if (!current_owner && !exited) {
+            thread_local ThreadExit thread_exit;
+            current_owner = new (std::nothrow) BiasedOwner;
+        }
+        return current_owner;
+    }
+
+    void attach(BiasedControlBlock * block) noexcept {
+        refs.fetch_add(1, std::memory_order_relaxed);
+        block->next_owned = owned;
+        if (owned) owned->prev_owned = block;
+        owned = block;
+    }
+
+    void release() noexcept {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+    }
+
+    // Moves the biased count into the atomic one, after which all threads
+    // use that.
+    void merge(BiasedControlBlock * block) noexcept {
+        if (block->prev_owned) block->prev_owned->next_owned = block->next_owned;
+        else owned = block->next_owned;
+        if (block->next_owned) block->next_owned->prev_owned = block->prev_owned;
+
+        int64_t add = static_cast<int64_t>(block->biased) * BiasedControlBlock::ONE + BiasedControlBlock::MERGED;
+        block->biased = 0;
+        block->merged = true;
+        if (block->shared.fetch_add(add, std::memory_order_acq_rel) + add == BiasedControlBlock::MERGED) {
+            BiasedControlBlock::destroy(block);
+        }
+    }
+
+    // Called by the thread that set QUEUED on block.
+    void push(BiasedControlBlock * block) noexcept {
+        BiasedControlBlock * head = inbox.load();
+        do {
+            if (head == CLOSED) {
+                // the owner has exited and merged everything it owned
+                dequeue(block);
+                return;
+            }
+            block->next_queued = head;
+        } while (!inbox.compare_exchange_weak(head, block));
+    }
+
+    static void dequeue(BiasedControlBlock * block) noexcept {
+        int64_t old = block->shared.fetch_and(~BiasedControlBlock::QUEUED, std::memory_order_acq_rel);
+        if ((old & ~BiasedControlBlock::QUEUED) == BiasedControlBlock::MERGED) {
+            BiasedControlBlock::destroy(block);
+        }
+    }
+
+    void drain(BiasedControlBlock * head) noexcept {
+        while (head) {
+            BiasedControlBlock * next = head->next_queued;
+            if (!head->merged) merge(head);
+            dequeue(head);
+            head = next;
+        }
+    }
+
+    void collect() noexcept {
+        if (inbox.load(std::memory_order_relaxed)) drain(inbox.exchange(nullptr));
+    }
+
+    void close() noexcept {
+        collect();
+        while (owned) merge(owned);
+        drain(inbox.exchange(CLOSED));
+        release();
+    }
+};
+
+inline void BiasedControlBlock::start() noexcept {
+    owner = BiasedOwner::current();
+    if (owner) {
+        owner->collect();
+        owner->attach(this);
+    } else {
+        // created during thread exit, counted atomically from the start
+        shared.store(ONE + MERGED, std::memory_order_relaxed);
+        biased = 0;
+        merged = true;
+    }
+}
+
+inline void BiasedControlBlock::destroy(BiasedControlBlock * block) noexcept {
+    BiasedOwner * owner = block->owner;
+    delete block;
+    if (owner) owner->release();
+}
+
+inline void BiasedControlBlock::add() noexcept {
+    if (owner == BiasedOwner::current_owner && !merged) {
+        ++biased;
+    } else {
+        shared.fetch_add(ONE, std::memory_order_relaxed);
+    }
+}
+
+inline void BiasedControlBlock::release() noexcept {
+    if (owner == BiasedOwner::current_owner && !merged) {
+        if (--biased == 0) {
+            owner->merge(this);
+            BiasedOwner::current_owner->collect();
+        }
+        return;
+    }
+    // Decrements and, when that leaves an unmerged count below zero, sets
+    // QUEUED in the same step, so the block cannot be freed before the
+    // owner has seen it.
+    int64_t old = shared.load(std::memory_order_relaxed), now;
+    do {
+        now = old - ONE;
+        if (!(now & (MERGED | QUEUED)) && (now >> 2) < 0) now |= QUEUED;
+    } while (!shared.compare_exchange_weak(old, now, std::memory_order_acq_rel, std::memory_order_relaxed));
+    if (now == MERGED) {
+        destroy(this);
+    } else if ((now & QUEUED) && !(old & QUEUED)) {
+        owner->push(this);
+    }
+}
+
+template <typename T>
+struct BiasedPointerBlock: BiasedControlBlock {
+    T * ptr;
+
+    explicit BiasedPointerBlock(T * ptr) noexcept: ptr(ptr) {}
+
+    ~BiasedPointerBlock() override {
+        delete ptr;
+    }
+};
+
+template <typename T>
+struct BiasedInlineBlock: BiasedControlBlock {
+    alignas(T) unsigned char bytes[sizeof(T)];
+
+    template <typename... Args>
+    explicit BiasedInlineBlock(Args&&... args) {
+        new (bytes) T(std::forward<Args>(args)...);
+    }
+
+    T * get() noexcept {
+        return std::launder(reinterpret_cast<T *>(bytes));
+    }
+
+    ~BiasedInlineBlock() override {
+        get()->~T();
+    }
+};
+
+struct BiasedCount {
+    // Merges the objects other threads have queued with the calling thread.
+    static void collect() noexcept {
+        if (BiasedOwner::current_owner) BiasedOwner::current_owner->collect();
+    }
+};
+
+template <typename T>
+class SharedPtr<T, BiasedCount> {
+private:
+    T * ptr = nullptr;
+    BiasedControlBlock * cnt = nullptr;
+
+    SharedPtr(T * ptr, BiasedControlBlock * cnt) noexcept: ptr(ptr), cnt(cnt) {}
+
+    void suicide() noexcept {
+        if (cnt) cnt->release();
+    }
+
+    template <typename U, typename C, typename... Args>
+    friend SharedPtr<U, C> MakeShared(Args&&... args);
+
+    template <typename... Args>
+    static SharedPtr make(Args&&... args) {
+        auto * block = new BiasedInlineBlock<T>(std::forward<Args>(args)...);
+        block->start();
+        return SharedPtr(block->get(), block);
+    }
+
+public:
+    SharedPtr() = default;
+    explicit SharedPtr(T * new_ptr): ptr(new_ptr) {
+        if (!new_ptr) return;
+        try {
+            cnt = new BiasedPointerBlock<T>(new_ptr);
+            cnt->start();
+        } catch (...) {
+            delete new_ptr;
+            throw;
+        }
+    }
+    explicit SharedPtr(std::nullptr_t) noexcept {}
+    SharedPtr(const SharedPtr& other) noexcept: ptr(other.ptr), cnt(other.cnt) {
+        if (cnt) cnt->add();
+    }
+    SharedPtr(SharedPtr&& other) noexcept: ptr(std::exchange(other.ptr, nullptr)), cnt(std::exchange(other.cnt, nullptr)) {}
+
+    SharedPtr& operator= (const SharedPtr& other) noexcept {
+        if (other.cnt) other.cnt->add();
+        suicide();
+        ptr = other.ptr;
+        cnt = other.cnt;
+        return *this;
+    }
+    SharedPtr& operator= (SharedPtr&& other) noexcept {
+        if (this != &other) {
+            suicide();
+            ptr = std::exchange(other.ptr, nullptr);
+            cnt = std::exchange(other.cnt, nullptr);
+        }
+        return *this;
+    }
+    SharedPtr& operator= (T * new_ptr) {
+        *this = SharedPtr(new_ptr);
+        return *this;
+    }
+    SharedPtr& operator= (std::nullptr_t) noexcept {
+        suicide();
+        ptr = nullptr;
+        cnt = nullptr;
+        return *this;
+    }
+
+    ~SharedPtr() noexcept {
+        suicide();
+    }
+
+    T& operator * () noexcept {
+        return *ptr;
+    }
+    const T& operator * () const noexcept {
+        return *ptr;
+    }
+    const T * operator -> () const noexcept {
+        return ptr;
+    }
+
+    void reset(T * other) {
+        *this = SharedPtr(other);
+    }
+
+    void swap(SharedPtr& other) noexcept {
         std::swap(ptr, other.ptr);
         std::swap(cnt, other.cnt);
     }
@@ -86,4 +733,4 @@ public:
     explicit operator bool() const noexcept {
         return ptr != nullptr;
     }
-};
\ No newline at end of file
+};
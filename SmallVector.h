@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <ratio>
+#include <type_traits>
+
+#include "MyVector.h"
+
+
+// Memory for Vector that holds up to N elements inside itself and goes to
+// the heap, through its RawMemory base, only for larger capacities. While the
+// elements are inline, buf points at storage and cp is N.
+template <typename T, size_t N, typename Allocator = MallocAllocator<T>>
+struct SmallRawMemory : RawMemory<T, Allocator> {
+    static_assert(N > 0, "use Vector for no inline elements");
+    static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_move_assignable_v<T>,
+                  "inline elements are moved on swap, which must not throw");
+
+    using Base = RawMemory<T, Allocator>;
+    using Base::buf;
+    using Base::cp;
+
+    static constexpr size_t inline_cp = N;
+
+    alignas(T) unsigned char storage[N * sizeof(T)];
+
+    T* Inline() {
+        return reinterpret_cast<T*>(storage);
+    }
+
+    [[nodiscard]] bool IsInline() const {
+        return buf == reinterpret_cast<const T*>(storage);
+    }
+
+    // Exchanges ownership of the heap buffers; a side that was inline gets
+    // its own inline storage back, the contents are not carried over.
+    void Swap(SmallRawMemory& other) noexcept {
+        bool was_inline = IsInline(), other_was_inline = other.IsInline();
+        Base::Swap(other);
+        if (other_was_inline) buf = Inline();
+        if (was_inline) other.buf = other.Inline();
+    }
+
+    bool TryResizeInPlace(size_t n) {
+        return !IsInline() && n > N && Base::TryResizeInPlace(n);
+    }
+
+    // Changes the capacity to n keeping the first live elements, which must
+    // be trivially relocatable. Capacities up to N go back inline.
+    void Resize(size_t n, size_t live) {
+        if (n <= N) {
+            if (!IsInline()) {
+                std::memcpy(static_cast<void*>(Inline()), static_cast<const void*>(buf), live * sizeof(T));
+                this->Deallocate(buf, cp);
+                buf = Inline();
+                cp = N;
+            }
+        } else if (IsInline()) {
+            T* heap = this->Allocate(n);
+            std::memcpy(static_cast<void*>(heap), static_cast<const void*>(buf), live * sizeof(T));
+            buf = heap;
+            cp = n;
+        } else {
+            Base::Resize(n, live);
+        }
+    }
+
+    SmallRawMemory() {
+        buf = Inline();
+        cp = N;
+    }
+
+    explicit SmallRawMemory(const Allocator& alloc)
+            : Base(alloc) {
+        buf = Inline();
+        cp = N;
+    }
+
+    explicit SmallRawMemory(size_t n, const Allocator& alloc = Allocator())
+            : Base(n > N ? n : 0, alloc) {
+        if (n <= N) {
+            buf = Inline();
+            cp = N;
+        }
+    }
+
+    SmallRawMemory(const SmallRawMemory&) = delete;
+    SmallRawMemory& operator=(const SmallRawMemory&) = delete;
+
+    ~SmallRawMemory() {
+        if (IsInline()) {
+            // nothing for the base to deallocate
+            buf = nullptr;
+            cp = 0;
+        }
+    }
+};
+
+template <typename T, size_t N = 8, typename Growth = std::ratio<2>>
+using SmallVector = Vector<T, SmallRawMemory<T, N>, Growth>;
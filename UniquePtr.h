@@ -1,69 +1,133 @@
+#pragma once
+
 #include <cstddef>
 #include <iostream>
+#include <type_traits>
+#include <utility>
+
+#include "ObjectPool.h"
 
 template <typename T>
-class UniquePtr {
-private:
-    T * ptr;
+struct DefaultDelete {
+    void operator() (T * ptr) const noexcept {
+        delete ptr;
+    }
+};
 
-public:
-    UniquePtr() {
-        ptr = nullptr;
+template <typename T>
+struct DefaultDelete<T[]> {
+    void operator() (T * ptr) const noexcept {
+        delete[] ptr;
     }
-    explicit UniquePtr(T * other) noexcept : ptr(other) {}
-    UniquePtr(UniquePtr&& other) noexcept : ptr(other.ptr) {
-        other.ptr = nullptr;
+};
+
+// Returns the object to its thread's ObjectPool instead of the heap.
+// Stateless, so UniquePtr<T, PoolDeleter<T>> stays pointer-sized.
+template <typename T>
+struct PoolDeleter {
+    void operator() (T * ptr) const noexcept {
+        ObjectPool<T>::destroy(ptr);
     }
+};
 
-    UniquePtr& operator= (std::nullptr_t null_ptr) noexcept {
-        ptr = null_ptr;
+// Ownership and deleter shared by UniquePtr<T> and UniquePtr<T[]>. An empty
+// deleter takes no space.
+template <typename T, typename Deleter>
+class UniquePtrBase {
+protected:
+    T * ptr = nullptr;
+    [[no_unique_address]] Deleter deleter;
+
+public:
+    UniquePtrBase() = default;
+    explicit UniquePtrBase(T * other) noexcept : ptr(other) {}
+    UniquePtrBase(T * other, const Deleter& deleter) noexcept : ptr(other), deleter(deleter) {}
+    UniquePtrBase(UniquePtrBase&& other) noexcept
+            : ptr(std::exchange(other.ptr, nullptr))
+            , deleter(std::move(other.deleter)) {}
+
+    UniquePtrBase& operator= (std::nullptr_t) noexcept {
+        reset();
         return *this;
     }
-    UniquePtr& operator= (UniquePtr&& other) noexcept {
+    UniquePtrBase& operator= (UniquePtrBase&& other) noexcept {
         if (this == &other) {
             return *this;
         }
-        delete this->ptr;
-        this->ptr = other.ptr;
-        other = nullptr;
+        reset(other.release());
+        deleter = std::move(other.deleter);
         return *this;
     }
 
-    ~UniquePtr() noexcept {
-        delete ptr;
-    }
-
-    T& operator * () const noexcept {
-        return *ptr;
-    }
-
-    T * operator -> () const noexcept {
-        return ptr;
+    ~UniquePtrBase() noexcept {
+        if (ptr) deleter(ptr);
     }
 
     T * release() noexcept {
-        T * tmp = ptr;
-        *this = nullptr;
-        return tmp;
+        return std::exchange(ptr, nullptr);
     }
 
-    void reset(T * other) noexcept {
-        delete this->ptr;
-        this->ptr = other;
+    // The old object is deleted after ptr is updated, so it may own this.
+    void reset(T * other = nullptr) noexcept {
+        T * old = std::exchange(ptr, other);
+        if (old) deleter(old);
     }
 
-    void swap(UniquePtr& other) {
+    void swap(UniquePtrBase& other) noexcept {
         std::swap(ptr, other.ptr);
+        std::swap(deleter, other.deleter);
     }
 
     [[nodiscard]] T * get() const noexcept {
         return ptr;
     }
 
+    Deleter& get_deleter() noexcept {
+        return deleter;
+    }
+    const Deleter& get_deleter() const noexcept {
+        return deleter;
+    }
+
     explicit operator bool() const noexcept {
         return (ptr != nullptr);
     }
 
-    UniquePtr& operator= (UniquePtr& other) = delete;
-    UniquePtr(UniquePtr& other) = delete;
-};
\ No newline at end of file
+    UniquePtrBase& operator= (const UniquePtrBase& other) = delete;
+    UniquePtrBase(const UniquePtrBase& other) = delete;
+};
+
+template <typename T, typename Deleter = DefaultDelete<T>>
+class UniquePtr : public UniquePtrBase<T, Deleter> {
+public:
+    using UniquePtrBase<T, Deleter>::UniquePtrBase;
+    using UniquePtrBase<T, Deleter>::operator=;
+
+    T& operator * () const noexcept {
+        return *this->ptr;
+    }
+
+    T * operator -> () const noexcept {
+        return this->ptr;
+    }
+};
+
+template <typename T, typename Deleter>
+class UniquePtr<T[], Deleter> : public UniquePtrBase<T, Deleter> {
+public:
+    using UniquePtrBase<T, Deleter>::UniquePtrBase;
+    using UniquePtrBase<T, Deleter>::operator=;
+
+    T& operator[] (size_t index) const noexcept {
+        return this->ptr[index];
+    }
+};
+
+template <typename T>
+using PooledPtr = UniquePtr<T, PoolDeleter<T>>;
+
+// Creates the object in memory from the calling thread's ObjectPool.
+template <typename T, typename... Args>
+PooledPtr<T> MakePooled(Args&&... args) {
+    return PooledPtr<T>(ObjectPool<T>::create(std::forward<Args>(args)...));
+}
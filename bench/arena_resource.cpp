@@ -0,0 +1,66 @@
+// Cost of the allocations one request makes: many short vectors and a few
+// long ones, built and dropped together. Compares MallocAllocator, PmrVector
+// over the default resource and over an ArenaResource that starts in a stack
+// buffer and is released after each request, and ArenaVector, which also
+// grows the newest buffer in place.
+
+#include <cstddef>
+#include <memory_resource>
+
+#include "../ArenaResource.h"
+#include "bench.h"
+
+static const int REQUESTS = 100000;
+static const size_t LENGTHS[] = {1, 2, 3, 5, 8, 13, 2, 1, 4, 3, 6, 1, 2, 9, 3, 256};
+
+template <typename MakeVector>
+static long serve(MakeVector make) {
+    long sum = 0;
+    for (int round = 0; round < 4; ++round) {
+        for (size_t length : LENGTHS) {
+            auto vec = make();
+            for (size_t i = 0; i < length; ++i) {
+                vec.push_back(static_cast<long>(i));
+            }
+            sum += vec[length / 2];
+        }
+    }
+    return sum;
+}
+
+template <typename F>
+static void report(const char* name, F request) {
+    long sum = 0;
+    double time = best_seconds([&] {
+        for (int i = 0; i < REQUESTS; ++i) {
+            sum += request();
+        }
+    });
+    keep(sum);
+    std::printf("%-28s %8.1f ns/request\n", name, time * 1e9 / REQUESTS);
+}
+
+int main() {
+    report("malloc", [] {
+        return serve([] { return Vector<long>(); });
+    });
+
+    report("pmr new_delete_resource", [] {
+        auto* resource = std::pmr::new_delete_resource();
+        return serve([resource] { return PmrVector<long>(std::pmr::polymorphic_allocator<long>(resource)); });
+    });
+
+    alignas(std::max_align_t) static char buffer[16 << 10];
+    ArenaResource arena(buffer, sizeof(buffer));
+    report("arena, pmr", [&arena] {
+        long sum = serve([&arena] { return PmrVector<long>(std::pmr::polymorphic_allocator<long>(&arena)); });
+        arena.release();
+        return sum;
+    });
+    report("arena, in-place growth", [&arena] {
+        long sum = serve([&arena] { return ArenaVector<long>(ArenaAllocator<long>(&arena)); });
+        arena.release();
+        return sum;
+    });
+    return 0;
+}
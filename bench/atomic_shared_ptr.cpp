@@ -0,0 +1,88 @@
+// Readers loading a shared configuration while a writer swaps in a new one
+// every millisecond: AtomicSharedPtr against a SharedPtr guarded by a mutex,
+// at 1, 8 and 64 reader threads. Reports loads per second over all readers
+// and the writer's mean time per store. Scaling only shows with as many
+// cores as readers.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../AtomicSharedPtr.h"
+#include "bench.h"
+
+struct Config {
+    long version;
+    long routes[15];
+};
+
+static const auto DURATION = std::chrono::milliseconds(500);
+
+class MutexSlot {
+private:
+    mutable std::mutex lock;
+    SharedPtr<Config> value;
+
+public:
+    explicit MutexSlot(SharedPtr<Config> value): value(std::move(value)) {}
+
+    SharedPtr<Config> load() const {
+        std::lock_guard guard(lock);
+        return value;
+    }
+
+    void store(SharedPtr<Config> desired) {
+        SharedPtr<Config> old;
+        {
+            std::lock_guard guard(lock);
+            old = std::move(value);
+            value = std::move(desired);
+        }
+    }
+};
+
+template <typename Slot>
+static void run(const char* name, int readers) {
+    Slot slot(MakeShared<Config>(Config{0, {}}));
+    std::atomic<bool> stop = false;
+    std::atomic<long> loads = 0;
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&] {
+            long count = 0, sum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                SharedPtr<Config> config = slot.load();
+                sum += (*config).version;
+                ++count;
+            }
+            keep(sum);
+            loads += count;
+        });
+    }
+    long stores = 0;
+    double store_time = 0;
+    double elapsed = seconds([&] {
+        auto end = std::chrono::steady_clock::now() + DURATION;
+        while (std::chrono::steady_clock::now() < end) {
+            SharedPtr<Config> next = MakeShared<Config>(Config{++stores, {}});
+            store_time += seconds([&] { slot.store(std::move(next)); });
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        stop = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+    std::printf("%-16s %2d readers  %8.2f M loads/s  store %8.1f us\n",
+                name, readers, loads / elapsed / 1e6, store_time / stores * 1e6);
+}
+
+int main() {
+    for (int readers : {1, 8, 64}) {
+        run<AtomicSharedPtr<Config>>("AtomicSharedPtr", readers);
+        run<MutexSlot>("mutex", readers);
+    }
+    return 0;
+}
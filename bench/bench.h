@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+
+// Helpers shared by the benchmarks. Each benchmark is its own executable and
+// prints one line per measurement.
+
+// Wall time of fn() in seconds.
+template <typename F>
+double seconds(F&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Shortest of runs timings of fn(), which filters out interruptions.
+template <typename F>
+double best_seconds(F&& fn, int runs = 5) {
+    double best = seconds(fn);
+    for (int i = 1; i < runs; ++i) {
+        double time = seconds(fn);
+        best = time < best ? time : best;
+    }
+    return best;
+}
+
+// Keeps the optimizer from dropping the computation of value.
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline bool has_flag(int argc, char** argv, const char* flag) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], flag) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
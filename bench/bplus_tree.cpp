@@ -0,0 +1,92 @@
+// BPlusTree against RedBlackTree: inserting n distinct keys in random order,
+// then looking up n present and n absent ones, and the heap memory the
+// tree takes per key. Runs 1e4 and 1e6 keys; --huge adds 1e8, which needs
+// about 6 GB.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+#include "../BPlusTree.h"
+#include "../RedBlackTree(Insertions).h"
+#include "bench.h"
+
+// A bijection, so distinct i give distinct keys in random order. Keys are
+// even, absent ones odd.
+static uint64_t key(uint64_t i) {
+    i += 0x9e3779b97f4a7c15ULL;
+    i = (i ^ (i >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    i = (i ^ (i >> 27)) * 0x94d049bb133111ebULL;
+    return (i ^ (i >> 31)) << 1;
+}
+
+// Heap bytes in use, counted by the replaced operator new and delete below.
+static size_t heap_bytes = 0;
+
+void* operator new(size_t size) {
+    void* p = std::malloc(size);
+    if (!p) throw std::bad_alloc();
+    heap_bytes += malloc_usable_size(p);
+    return p;
+}
+void* operator new(size_t size, std::align_val_t alignment) {
+    size_t align = static_cast<size_t>(alignment);
+    void* p = std::aligned_alloc(align, (size + align - 1) / align * align);
+    if (!p) throw std::bad_alloc();
+    heap_bytes += malloc_usable_size(p);
+    return p;
+}
+void operator delete(void* p) noexcept {
+    if (p) heap_bytes -= malloc_usable_size(p);
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    operator delete(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    operator delete(p);
+}
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    operator delete(p);
+}
+
+template <typename Tree>
+static void run(const char* name, uint64_t n) {
+    size_t before = heap_bytes;
+    Tree tree;
+    double insert = seconds([&] {
+        for (uint64_t i = 0; i < n; ++i) {
+            tree.insert(key(i));
+        }
+    });
+    double per_key = static_cast<double>(heap_bytes - before) / static_cast<double>(n);
+    size_t found = 0;
+    double hit = best_seconds([&] {
+        for (uint64_t i = 0; i < n; ++i) {
+            found += tree.contains(key(i * 7 % n));
+        }
+    }, 3);
+    double miss = best_seconds([&] {
+        for (uint64_t i = 0; i < n; ++i) {
+            found += tree.contains(key(i) | 1);
+        }
+    }, 3);
+    keep(found);
+    std::printf("%-12s n=%-10llu insert %7.1f ns  hit %7.1f ns  miss %7.1f ns  %6.1f bytes/key\n",
+                name, static_cast<unsigned long long>(n),
+                insert * 1e9 / n, hit * 1e9 / n, miss * 1e9 / n, per_key);
+}
+
+int main(int argc, char** argv) {
+    for (uint64_t n : {uint64_t(10000), uint64_t(1000000), uint64_t(100000000)}) {
+        if (n > 1000000 && !has_flag(argc, argv, "--huge")) {
+            break;
+        }
+        run<RedBlackTree<uint64_t>>("RedBlackTree", n);
+        run<BPlusTree<uint64_t>>("BPlusTree", n);
+    }
+    return 0;
+}
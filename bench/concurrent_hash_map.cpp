@@ -0,0 +1,98 @@
+// Contention: threads doing 90% lookups and 10% writes on 1e5 prefilled
+// keys, ConcurrentHashMap against one std::mutex around HashMap, at 1, 8
+// and 64 threads. Reports operations per second over all threads. Scaling
+// only shows with as many cores as threads.
+
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../ConcurrentHashMap.h"
+#include "../HashTable(Vector).h"
+#include "bench.h"
+
+static const uint64_t KEYS = 100000;
+static const uint64_t OPS = 2000000;
+
+class MutexMap {
+private:
+    mutable std::mutex lock;
+    HashMap<uint64_t, uint64_t> map;
+
+public:
+    bool find(uint64_t key, uint64_t& value) const {
+        std::lock_guard guard(lock);
+        auto it = map.find(key);
+        if (it == map.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void assign(uint64_t key, uint64_t value) {
+        std::lock_guard guard(lock);
+        map.insert_or_assign(key, value);
+    }
+};
+
+class ShardedMap {
+private:
+    ConcurrentHashMap<uint64_t, uint64_t> map;
+
+public:
+    bool find(uint64_t key, uint64_t& value) const {
+        auto found = map.find(key);
+        if (!found) {
+            return false;
+        }
+        value = *found;
+        return true;
+    }
+
+    void assign(uint64_t key, uint64_t value) {
+        map.insert_or_assign(key, value);
+    }
+};
+
+template <typename Map>
+static void run(const char* name, int thread_count) {
+    Map map;
+    for (uint64_t key = 0; key < KEYS; ++key) {
+        map.assign(key, key);
+    }
+    uint64_t per_thread = OPS / thread_count;
+    double time = seconds([&] {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&map, per_thread, t] {
+                uint64_t state = t + 1, sum = 0;
+                for (uint64_t i = 0; i < per_thread; ++i) {
+                    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                    uint64_t key = (state >> 33) % KEYS;
+                    if ((state >> 20) % 10 == 0) {
+                        map.assign(key, i);
+                    } else {
+                        uint64_t value = 0;
+                        map.find(key, value);
+                        sum += value;
+                    }
+                }
+                keep(sum);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    });
+    std::printf("%-18s %2d threads  %7.2f M ops/s\n", name, thread_count, per_thread * thread_count / time / 1e6);
+}
+
+int main() {
+    for (int threads : {1, 8, 64}) {
+        run<ShardedMap>("ConcurrentHashMap", threads);
+        run<MutexMap>("mutex + HashMap", threads);
+    }
+    return 0;
+}
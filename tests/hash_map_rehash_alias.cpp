@@ -0,0 +1,55 @@
+// Indexing, inserting and erasing with references into the map while an
+// incremental rehash is running must not read entries the rehash moved.
+
+#include <cassert>
+#include <string>
+
+#include "../HashTable(Vector).h"
+
+using Map = HashMap<std::string, std::string>;
+
+static const size_t COUNT = 2049;
+
+// 2049 entries grow the table incrementally and leave the rehash running.
+// Iteration visits the old table in slot order after the new one, so the
+// first entries it yields are the next ones the rehash moves.
+static void fill(Map& m) {
+    for (size_t i = 0; i < COUNT; ++i) {
+        m["key" + std::to_string(i)] = "value" + std::to_string(i);
+    }
+}
+
+int main() {
+    for (size_t skip = 0; skip < 16; ++skip) {
+        Map m;
+        fill(m);
+        auto it = m.begin();
+        for (size_t i = 0; i < skip; ++i) ++it;
+        std::string key = it->first;
+        m[it->first] += "!";
+        assert(m.size() == COUNT);
+        assert(m.find(key)->second.back() == '!');
+    }
+    for (size_t skip = 0; skip < 16; ++skip) {
+        // an absent key taken from a mapped value, which the insertion moves
+        Map m;
+        fill(m);
+        auto it = m.begin();
+        for (size_t i = 0; i < skip; ++i) ++it;
+        std::string value = it->second;
+        m.try_emplace(it->second, it->second);
+        assert(m.size() == COUNT + 1);
+        assert(m.find(value)->second == value);
+    }
+    for (size_t skip = 0; skip < 16; ++skip) {
+        Map m;
+        fill(m);
+        auto it = m.begin();
+        for (size_t i = 0; i < skip; ++i) ++it;
+        std::string key = it->first;
+        assert(m.erase(it->first) == 1);
+        assert(m.size() == COUNT - 1);
+        assert(m.find(key) == m.end());
+    }
+    return 0;
+}